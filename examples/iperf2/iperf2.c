@@ -0,0 +1,1066 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "wizchip_conf.h"
+#include "w5x00_spi.h"
+
+#include "socket.h"
+
+#include "iperf.h"
+#include "iperf2.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Buffer */
+#define ETHERNET_BUF_MAX_SIZE (1024 * 16)
+
+/* Reverse test, write size when the client header gives none */
+#define IPERF2_TCP_WRITE_SIZE (1024 * 8)
+
+/* Time unit of a timed test in the client header */
+#define IPERF2_AMOUNT_TIME_US 10000
+
+/* Listeners beyond the expected connections keep this much RX buffer, so a test with more connections is still accepted */
+#define IPERF2_SPARE_BUF_KB 1
+
+/* TX buffer of the listeners, they only send ACKs */
+#define IPERF2_MIN_BUF_KB 1
+
+/* Receive engine : reads smaller than this wait up to IPERF2_RX_HOLDOFF_US for more data, each read costs a RECV command */
+#define IPERF2_RX_MIN_READ 512
+#define IPERF2_RX_HOLDOFF_US 200
+
+/* Server report flags */
+#define IPERF2_SERVER_HDR_VERSION1 0x80000000
+
+/* Client, largest UDP payload in one Ethernet frame and the final datagram retries */
+#define IPERF2_UDP_MAX_LEN 1472
+#define IPERF2_CLIENT_FIN_TRIES 10
+#define IPERF2_CLIENT_FIN_WAIT_US 250000
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Connection of the listener pool */
+typedef struct
+{
+    uint8_t sn;
+    uint8_t id; // Connection number printed in the reports
+    uint8_t peer_ip[4];
+    uint16_t peer_port;
+    uint8_t hdr_buf[IPERF2_CLIENT_HDR_SIZE];
+    uint8_t hdr_len;
+    bool tradeoff;
+    char label[8];
+    Stats stats;
+    uint64_t rx_wait_us; // When a read was first held back, 0 if none is
+    uint32_t rx_bursts;  // Reads issued
+    uint32_t rx_held;    // Reads held back to gather more data
+} iperf2_conn_t;
+
+/* Listener pool */
+static iperf2_conn_t g_conns[IPERF2_MAX_CONNECTIONS];
+static uint8_t g_num_conns = 0;
+static uint8_t g_sn_client = 1;
+static uint16_t g_port = 0;
+static uint8_t g_expected_conns = 0; // Connections the socket buffers are sized for
+static uint8_t g_test_conns = 0;     // Connections of the running test
+static uint8_t g_test_threads = 0;   // Parallel streams announced by the client headers
+static bool g_test_reverse = false;  // The reverse test of this test has been claimed
+static uint64_t g_test_bytes = 0;
+static uint64_t g_test_start_us = 0;
+
+/* Reverse test, from the header of the connection that asked for it */
+static uint8_t g_peer_ip[4] = {0};
+static iperf2_client_hdr_t g_hdr;
+
+/* Reverse test */
+static uint16_t g_tx_len = 0;
+static uint64_t g_tx_end_us = 0;
+static uint64_t g_tx_bytes_left = 0;
+static bool g_tx_timed = false;
+static bool g_tx_done = false;  // The test time or amount was reached
+static uint32_t g_tx_rate = 0;  // Bits/sec of the client, 0 for unlimited
+
+/* UDP */
+static uint8_t g_udp_sn = 0;
+static uint16_t g_udp_port = 0;
+static bool g_udp_active = false;
+static uint8_t g_udp_peer_ip[4] = {0};
+static uint16_t g_udp_peer_port = 0;
+static int32_t g_udp_first_id = 0;
+static int32_t g_udp_last_id = 0;
+static uint32_t g_udp_errors = 0;
+static uint32_t g_udp_outorder = 0;
+static Jitter g_udp_jitter;
+static uint64_t g_udp_first_us = 0;
+static uint64_t g_udp_last_us = 0;
+
+/* Statistics */
+static Stats g_tx_stats;
+static Stats g_udp_stats;
+
+/* iperf */
+static uint8_t g_iperf_buf[ETHERNET_BUF_MAX_SIZE] = {
+    0,
+};
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Client header */
+static void iperf2_header_take(iperf2_conn_t *conn, const uint8_t *buf, uint16_t len);
+static void iperf2_header_put(uint8_t *buf, const iperf2_client_hdr_t *hdr);
+static uint32_t iperf2_get_u32(const uint8_t *buf);
+static void iperf2_put_u32(uint8_t *buf, uint32_t value);
+
+/* Listener pool */
+static bool iperf2_conn_process(iperf2_conn_t *conn);
+static void iperf2_conn_start(iperf2_conn_t *conn);
+static void iperf2_conn_recv(iperf2_conn_t *conn, bool closing);
+static uint16_t iperf2_rx_chunk(uint16_t rsr, uint16_t rx_max);
+static void iperf2_conn_stop(iperf2_conn_t *conn);
+static void iperf2_pool_stop(void);
+static void iperf2_pool_buffers(uint8_t expected);
+static void iperf2_buf_fill(void);
+
+/* Reverse test and client */
+static void iperf2_client_start(bool header);
+static void iperf2_client_send(void);
+static void iperf2_client_stop(void);
+
+/* Client */
+static int8_t iperf2_client_tcp(iperf2_client_result_t *result);
+static int8_t iperf2_client_udp(const iperf2_client_config_t *config, iperf2_client_result_t *result);
+static void iperf2_client_report(const uint8_t *hdr, iperf2_client_result_t *result);
+
+/* UDP */
+static void iperf2_udp_start(const uint8_t *ip, uint16_t port, int32_t id);
+static void iperf2_udp_account(const uint8_t *buf, uint16_t len, uint64_t now_us);
+static void iperf2_udp_stop(void);
+static uint32_t iperf2_udp_datagrams(void);
+static void iperf2_udp_report(uint8_t *buf, uint16_t len);
+
+void iperf2_server_initialize(uint8_t sn_first, uint8_t num_sockets, uint8_t sn_client, uint16_t port)
+{
+    if (num_sockets > IPERF2_MAX_CONNECTIONS)
+    {
+        num_sockets = IPERF2_MAX_CONNECTIONS;
+    }
+
+    g_num_conns = num_sockets;
+    g_sn_client = sn_client;
+    g_port = port;
+
+    for (uint8_t i = 0; i < g_num_conns; i++)
+    {
+        iperf2_conn_t *conn = &g_conns[i];
+
+        memset(conn, 0, sizeof(iperf2_conn_t));
+        conn->sn = sn_first + i;
+        conn->id = i + 1;
+        snprintf(conn->label, sizeof(conn->label), "[%2d] ", conn->id);
+
+        iperf_stats_init(&conn->stats, 1000);
+        conn->stats.interval_report = true;
+        conn->stats.label = conn->label;
+    }
+
+    iperf_stats_init(&g_tx_stats, 1000);
+    g_tx_stats.interval_report = true;
+    g_tx_stats.label = "[tx] ";
+
+    iperf2_buf_fill();
+
+    // Until a client tells otherwise, every listener gets the same share
+    iperf2_pool_buffers(g_num_conns);
+
+    printf("[iperf] Server listening on TCP port %d with %d sockets\n", g_port, g_num_conns);
+}
+
+void iperf2_server_process(void)
+{
+    uint8_t active = 0;
+
+    for (uint8_t i = 0; i < g_num_conns; i++)
+    {
+        if (iperf2_conn_process(&g_conns[i]))
+        {
+            active++;
+        }
+    }
+
+    if (active == 0 && g_test_conns > 0)
+    {
+        iperf2_pool_stop();
+    }
+
+    iperf2_client_send();
+
+    for (uint8_t i = 0; i < g_num_conns; i++)
+    {
+        iperf_stats_update(&g_conns[i].stats, false);
+    }
+    iperf_stats_update(&g_tx_stats, false);
+}
+
+/* Listener pool, returns whether the connection is part of a running test */
+static bool iperf2_conn_process(iperf2_conn_t *conn)
+{
+    switch (getSn_SR(conn->sn))
+    {
+    case SOCK_ESTABLISHED:
+        if (!conn->stats.running)
+        {
+            iperf2_conn_start(conn);
+        }
+        iperf2_conn_recv(conn, false);
+        break;
+    case SOCK_CLOSE_WAIT:
+        // Data still in the socket buffer belongs to the test
+        if (getSn_RX_RSR(conn->sn) > 0)
+        {
+            iperf2_conn_recv(conn, true);
+            break;
+        }
+        iperf2_conn_stop(conn);
+        disconnect(conn->sn);
+        break;
+    case SOCK_INIT:
+        listen(conn->sn);
+        break;
+    case SOCK_CLOSED:
+        // Back to LISTEN, also after a reset by the peer
+        iperf2_conn_stop(conn);
+        socket(conn->sn, Sn_MR_TCP, g_port, 0x00);
+        break;
+    default:
+        break;
+    }
+
+    return conn->stats.running;
+}
+
+static void iperf2_conn_start(iperf2_conn_t *conn)
+{
+    getSn_DIPR(conn->sn, conn->peer_ip);
+    conn->peer_port = getSn_DPORT(conn->sn);
+
+    conn->hdr_len = 0;
+    conn->tradeoff = false;
+    conn->rx_wait_us = 0;
+    conn->rx_bursts = 0;
+    conn->rx_held = 0;
+
+    if (g_test_conns == 0)
+    {
+        g_test_bytes = 0;
+        g_test_threads = 0;
+        g_test_reverse = false;
+        g_test_start_us = time_us_64();
+    }
+    g_test_conns++;
+
+    printf("%sReceiving from %d.%d.%d.%d:%d\n", conn->label,
+           conn->peer_ip[0], conn->peer_ip[1], conn->peer_ip[2], conn->peer_ip[3], conn->peer_port);
+
+    iperf_stats_start(&conn->stats);
+}
+
+/* Bytes to read in one burst, from how full the socket RX buffer is */
+static uint16_t iperf2_rx_chunk(uint16_t rsr, uint16_t rx_max)
+{
+    // Nearly full : drain it all, the advertised window is about to close
+    if (rsr >= rx_max / 4 * 3)
+    {
+        return rx_max;
+    }
+
+    // Otherwise bounded bursts, so the other connections of the pool are served in between
+    if (rsr >= rx_max / 4)
+    {
+        return rx_max / 2;
+    }
+
+    return rx_max / 4;
+}
+
+static void iperf2_conn_recv(iperf2_conn_t *conn, bool closing)
+{
+    uint16_t rsr = getSn_RX_RSR(conn->sn);
+    uint16_t len = 0;
+    uint64_t now_us = 0;
+
+    if (rsr == 0)
+    {
+        return;
+    }
+
+    // A small read costs the same command overhead as a full one, so give the data a moment to build up
+    if (rsr < IPERF2_RX_MIN_READ && !closing)
+    {
+        now_us = time_us_64();
+
+        if (conn->rx_wait_us == 0)
+        {
+            conn->rx_wait_us = now_us;
+            conn->rx_held++;
+            return;
+        }
+        if (now_us - conn->rx_wait_us < IPERF2_RX_HOLDOFF_US)
+        {
+            return;
+        }
+    }
+    conn->rx_wait_us = 0;
+
+    // Exactly what has arrived, never more
+    len = iperf2_rx_chunk(rsr, getSn_RxMAX(conn->sn));
+    if (len > rsr)
+    {
+        len = rsr;
+    }
+    if (len > sizeof(g_iperf_buf))
+    {
+        len = sizeof(g_iperf_buf);
+    }
+
+    recv_iperf(conn->sn, g_iperf_buf, len);
+    conn->rx_bursts++;
+
+    if (conn->hdr_len < IPERF2_CLIENT_HDR_SIZE)
+    {
+        iperf2_header_take(conn, g_iperf_buf, len);
+    }
+
+    iperf_stats_add_bytes(&conn->stats, len);
+}
+
+static void iperf2_conn_stop(iperf2_conn_t *conn)
+{
+    if (!conn->stats.running)
+    {
+        return;
+    }
+
+    iperf_stats_update(&conn->stats, true);
+    iperf_stats_stop(&conn->stats);
+
+    printf("%sReads : %u bursts, %llu bytes per burst on average, %u held back to gather more data\n",
+           conn->label, conn->rx_bursts,
+           conn->rx_bursts ? (unsigned long long)(conn->stats.nb0 / conn->rx_bursts) : 0ULL, conn->rx_held);
+
+    g_test_bytes += conn->stats.nb0;
+
+    // Tradeoff test : the reverse test starts once the client is done sending
+    if (conn->tradeoff)
+    {
+        conn->tradeoff = false;
+        iperf2_client_start(false);
+    }
+}
+
+/* The last connection of a test has closed */
+static void iperf2_pool_stop(void)
+{
+    uint8_t expected = g_test_conns;
+    double total_time_s = (time_us_64() - g_test_start_us) / 1e6;
+
+    if (g_test_conns > 1)
+    {
+        printf("[SUM] Total: %5.2f sec %8llu Bytes  %5.2f Mbits/sec  %d connections\n",
+               total_time_s, (unsigned long long)g_test_bytes,
+               total_time_s > 0 ? g_test_bytes * 8 / 1e6 / total_time_s : 0.0, g_test_conns);
+    }
+
+    // Size the buffers for the next test like this one, the headers know about connections that were refused
+    if (g_test_threads > expected)
+    {
+        expected = g_test_threads;
+    }
+    if (expected > g_num_conns)
+    {
+        expected = g_num_conns;
+    }
+
+    g_test_conns = 0;
+
+    if (expected != g_expected_conns)
+    {
+        iperf2_pool_buffers(expected);
+    }
+}
+
+/* Same payload pattern as the iperf2 client */
+static void iperf2_buf_fill(void)
+{
+    for (uint32_t i = 0; i < sizeof(g_iperf_buf); i++)
+    {
+        g_iperf_buf[i] = '0' + (i % 10);
+    }
+}
+
+/* Socket buffer sizes can only be changed while the sockets are closed, so the listeners are closed and reopened */
+static void iperf2_pool_buffers(uint8_t expected)
+{
+    uint8_t spare = g_num_conns - expected;
+    uint8_t rx_kb = wizchip_buf_kb(WIZCHIP_BUF_TOTAL_KB - spare * IPERF2_SPARE_BUF_KB, expected);
+    uint8_t tx_kb = wizchip_buf_kb(WIZCHIP_BUF_TOTAL_KB - g_num_conns * IPERF2_MIN_BUF_KB, 1);
+
+    // Sockets outside the pool and the client one are not used, the sizes above count on their memory
+    for (uint8_t sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+    {
+        if (sn != g_sn_client && (sn < g_conns[0].sn || sn >= g_conns[0].sn + g_num_conns))
+        {
+            close(sn);
+            setSn_RXBUF_SIZE(sn, 0);
+            setSn_TXBUF_SIZE(sn, 0);
+        }
+    }
+
+    for (uint8_t i = 0; i < g_num_conns; i++)
+    {
+        close(g_conns[i].sn);
+        setSn_RXBUF_SIZE(g_conns[i].sn, i < expected ? rx_kb : IPERF2_SPARE_BUF_KB);
+        setSn_TXBUF_SIZE(g_conns[i].sn, IPERF2_MIN_BUF_KB);
+    }
+
+    // The reverse test socket only sends, incoming ACKs need no buffer
+    if (!g_tx_stats.running)
+    {
+        setSn_RXBUF_SIZE(g_sn_client, 0);
+        setSn_TXBUF_SIZE(g_sn_client, tx_kb);
+    }
+
+    g_expected_conns = expected;
+
+    printf("[iperf] Socket buffers : RX %d KB on %d sockets, %d KB on %d spare sockets, reverse TX %d KB\n",
+           rx_kb, expected, IPERF2_SPARE_BUF_KB, spare, tx_kb);
+}
+
+/* Client header */
+static uint32_t iperf2_get_u32(const uint8_t *buf)
+{
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static void iperf2_put_u32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = (uint8_t)(value >> 24);
+    buf[1] = (uint8_t)(value >> 16);
+    buf[2] = (uint8_t)(value >> 8);
+    buf[3] = (uint8_t)value;
+}
+
+static void iperf2_header_put(uint8_t *buf, const iperf2_client_hdr_t *hdr)
+{
+    iperf2_put_u32(buf, hdr->flags);
+    iperf2_put_u32(buf + 4, (uint32_t)hdr->num_threads);
+    iperf2_put_u32(buf + 8, hdr->port);
+    iperf2_put_u32(buf + 12, hdr->buffer_len);
+    iperf2_put_u32(buf + 16, hdr->win_band);
+    iperf2_put_u32(buf + 20, (uint32_t)hdr->amount);
+}
+
+static void iperf2_header_take(iperf2_conn_t *conn, const uint8_t *buf, uint16_t len)
+{
+    uint16_t copy = IPERF2_CLIENT_HDR_SIZE - conn->hdr_len;
+    iperf2_client_hdr_t hdr;
+
+    if (copy > len)
+    {
+        copy = len;
+    }
+
+    memcpy(conn->hdr_buf + conn->hdr_len, buf, copy);
+    conn->hdr_len += copy;
+
+    if (conn->hdr_len < IPERF2_CLIENT_HDR_SIZE)
+    {
+        return;
+    }
+
+    hdr.flags = iperf2_get_u32(conn->hdr_buf);
+    hdr.num_threads = (int32_t)iperf2_get_u32(conn->hdr_buf + 4);
+    hdr.port = iperf2_get_u32(conn->hdr_buf + 8);
+    hdr.buffer_len = iperf2_get_u32(conn->hdr_buf + 12);
+    hdr.win_band = iperf2_get_u32(conn->hdr_buf + 16);
+    hdr.amount = (int32_t)iperf2_get_u32(conn->hdr_buf + 20);
+
+    // Plain tests send the header without flags, clients without a header send the '0123...' pattern instead
+    if (hdr.num_threads > g_test_threads && hdr.num_threads <= IPERF2_MAX_CONNECTIONS)
+    {
+        g_test_threads = (uint8_t)hdr.num_threads;
+    }
+
+    if ((hdr.flags & IPERF2_HEADER_VERSION1) == 0)
+    {
+        return;
+    }
+
+#ifdef IPERF_DEBUG
+    printf("[iperf] Client header: flags 0x%08X, threads %d, port %u, len %u, amount %d\n",
+           hdr.flags, hdr.num_threads, hdr.port, hdr.buffer_len, hdr.amount);
+#endif
+
+    // Every parallel stream asks for the reverse test, only the first one is run
+    if (g_test_reverse || g_tx_stats.running)
+    {
+        return;
+    }
+    g_test_reverse = true;
+
+    g_hdr = hdr;
+    memcpy(g_peer_ip, conn->peer_ip, 4);
+
+    if (hdr.flags & IPERF2_RUN_NOW)
+    {
+        iperf2_client_start(false);
+    }
+    else
+    {
+        conn->tradeoff = true;
+    }
+}
+
+/* Reverse test and client, the client opens its test with the client header */
+static void iperf2_client_start(bool header)
+{
+    uint8_t hdr_buf[IPERF2_CLIENT_HDR_SIZE];
+    int8_t retval = 0;
+
+    if (g_tx_stats.running)
+    {
+        printf("[iperf] Reverse test already running\n");
+        return;
+    }
+
+    if (g_hdr.num_threads > 1)
+    {
+        printf("[iperf] Only one reverse stream is supported, %d requested\n", g_hdr.num_threads);
+    }
+
+    g_tx_len = IPERF2_TCP_WRITE_SIZE;
+    if (g_hdr.buffer_len != 0 && g_hdr.buffer_len < sizeof(g_iperf_buf))
+    {
+        g_tx_len = g_hdr.buffer_len;
+    }
+
+    // The amount is a byte count, or minus the test time in 10 ms units
+    g_tx_timed = (g_hdr.amount < 0);
+    if (g_tx_timed)
+    {
+        g_tx_end_us = time_us_64() + (uint64_t)(-(int64_t)g_hdr.amount) * IPERF2_AMOUNT_TIME_US;
+    }
+    else
+    {
+        g_tx_bytes_left = (uint32_t)g_hdr.amount;
+    }
+
+    socket(g_sn_client, Sn_MR_TCP, 0, 0x00);
+
+    // A write must fit in the socket TX buffer, it is only issued once there is room for all of it
+    if (g_tx_len > getSn_TxMAX(g_sn_client))
+    {
+        g_tx_len = getSn_TxMAX(g_sn_client);
+    }
+
+    retval = connect(g_sn_client, g_peer_ip, (uint16_t)g_hdr.port);
+    if (retval != SOCK_OK)
+    {
+        printf("[iperf] Failed to connect to %d.%d.%d.%d:%u (%d)\n",
+               g_peer_ip[0], g_peer_ip[1], g_peer_ip[2], g_peer_ip[3], g_hdr.port, retval);
+        close(g_sn_client);
+        return;
+    }
+
+    printf("[iperf] Sending to %d.%d.%d.%d:%u\n",
+           g_peer_ip[0], g_peer_ip[1], g_peer_ip[2], g_peer_ip[3], g_hdr.port);
+
+    g_tx_done = false;
+    iperf_stats_start(&g_tx_stats);
+
+    if (header)
+    {
+        // The server reads the header as the start of the data
+        iperf2_header_put(hdr_buf, &g_hdr);
+        send_iperf(g_sn_client, hdr_buf, IPERF2_CLIENT_HDR_SIZE);
+        iperf_stats_add_bytes(&g_tx_stats, IPERF2_CLIENT_HDR_SIZE);
+
+        if (!g_tx_timed)
+        {
+            g_tx_bytes_left = (g_tx_bytes_left > IPERF2_CLIENT_HDR_SIZE) ? g_tx_bytes_left - IPERF2_CLIENT_HDR_SIZE : 0;
+        }
+    }
+}
+
+static void iperf2_client_send(void)
+{
+    uint16_t len = g_tx_len;
+    int32_t sent = 0;
+
+    if (!g_tx_stats.running)
+    {
+        return;
+    }
+
+    if (getSn_SR(g_sn_client) != SOCK_ESTABLISHED)
+    {
+        printf("[iperf] Connection closed by the peer\n");
+        iperf2_client_stop();
+        return;
+    }
+
+    if (g_tx_timed ? (time_us_64() >= g_tx_end_us) : (g_tx_bytes_left == 0))
+    {
+        g_tx_done = true;
+        iperf2_client_stop();
+        return;
+    }
+
+    if (!g_tx_timed && g_tx_bytes_left < len)
+    {
+        len = (uint16_t)g_tx_bytes_left;
+    }
+
+    // Do not wait for buffer space, the server socket must keep being served in a dual test
+    if (getSn_TX_FSR(g_sn_client) < len)
+    {
+        // The last write may still wait for its SEND
+        send_iperf_flush(g_sn_client);
+        return;
+    }
+
+    // Paced over the whole test, so a late write is caught up
+    if (g_tx_rate != 0 && g_tx_stats.nb0 * 8 * 1000000 >= (uint64_t)g_tx_rate * (time_us_64() - g_tx_stats.t0))
+    {
+        send_iperf_flush(g_sn_client);
+        return;
+    }
+
+    sent = send_iperf(g_sn_client, g_iperf_buf, len);
+    if (sent <= 0)
+    {
+        printf("[iperf] Send failed (%d)\n", sent);
+        iperf2_client_stop();
+        return;
+    }
+
+    if (!g_tx_timed)
+    {
+        g_tx_bytes_left -= sent;
+    }
+
+    iperf_stats_add_bytes(&g_tx_stats, sent);
+}
+
+static void iperf2_client_stop(void)
+{
+    iperf_stats_update(&g_tx_stats, true);
+    iperf_stats_stop(&g_tx_stats);
+
+    // Data written by send_iperf may still wait for its SEND
+    while (!send_iperf_flush(g_sn_client))
+        ;
+
+    disconnect(g_sn_client);
+    close(g_sn_client);
+}
+
+/* Client */
+void iperf2_client_initialize(uint8_t sn)
+{
+    g_sn_client = sn;
+
+    iperf_stats_init(&g_tx_stats, 1000);
+    g_tx_stats.interval_report = true;
+    g_tx_stats.label = "[tx] ";
+
+    iperf2_buf_fill();
+
+    // Only the client sends, its socket gets all of the TX buffer memory
+    for (uint8_t i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+    {
+        close(i);
+        setSn_TXBUF_SIZE(i, (i == sn) ? wizchip_buf_kb(WIZCHIP_BUF_TOTAL_KB, 1) : 0);
+    }
+}
+
+int8_t iperf2_client_run(const iperf2_client_config_t *config, iperf2_client_result_t *result)
+{
+    memset(result, 0, sizeof(iperf2_client_result_t));
+
+    memset(&g_hdr, 0, sizeof(iperf2_client_hdr_t));
+    g_hdr.num_threads = 1;
+    g_hdr.port = config->port;
+    g_hdr.buffer_len = config->len;
+    // The amount is a byte count, or minus the test time in 10 ms units
+    g_hdr.amount = (config->amount != 0) ? (int32_t)config->amount
+                                         : -(int32_t)((uint32_t)config->time * (1000000 / IPERF2_AMOUNT_TIME_US));
+    memcpy(g_peer_ip, config->server_ip, 4);
+
+    if (config->udp)
+    {
+        return iperf2_client_udp(config, result);
+    }
+
+    g_tx_rate = config->bandwidth;
+
+    return iperf2_client_tcp(result);
+}
+
+static int8_t iperf2_client_tcp(iperf2_client_result_t *result)
+{
+    iperf2_client_start(true);
+
+    while (g_tx_stats.running)
+    {
+        iperf2_client_send();
+        iperf_stats_update(&g_tx_stats, false);
+    }
+
+    // The reverse test of the server is never paced
+    g_tx_rate = 0;
+
+    result->ok = g_tx_done;
+    result->seconds = (g_tx_stats.t3 - g_tx_stats.t0) / 1e6;
+    result->bytes = g_tx_stats.nb0;
+
+    return result->ok ? 0 : -1;
+}
+
+static int8_t iperf2_client_udp(const iperf2_client_config_t *config, iperf2_client_result_t *result)
+{
+    uint16_t len = config->len ? config->len : IPERF2_CLIENT_UDP_LEN;
+    uint32_t bandwidth = config->bandwidth ? config->bandwidth : IPERF2_CLIENT_UDP_BANDWIDTH;
+    uint64_t now_us = 0;
+    uint64_t end_us = 0;
+    int32_t id = 0;
+    int32_t received = 0;
+    uint8_t ip[4] = {0};
+    uint16_t port = 0;
+
+    if (len < IPERF2_UDP_HDR_SIZE + IPERF2_CLIENT_HDR_SIZE)
+    {
+        len = IPERF2_UDP_HDR_SIZE + IPERF2_CLIENT_HDR_SIZE;
+    }
+    if (len > IPERF2_UDP_MAX_LEN)
+    {
+        len = IPERF2_UDP_MAX_LEN;
+    }
+
+    g_hdr.win_band = bandwidth;
+
+    socket(g_sn_client, Sn_MR_UDP, 0, 0x00);
+    setSn_DIPR(g_sn_client, g_peer_ip);
+    setSn_DPORT(g_sn_client, config->port);
+
+    printf("[iperf] Sending %d byte datagrams to %d.%d.%d.%d:%u at %u bits/sec\n",
+           len, g_peer_ip[0], g_peer_ip[1], g_peer_ip[2], g_peer_ip[3], config->port, bandwidth);
+
+    // Every datagram carries the client header after the datagram header, as the iperf2 client sends it
+    iperf2_header_put(g_iperf_buf + IPERF2_UDP_HDR_SIZE, &g_hdr);
+
+    iperf_stats_start(&g_tx_stats);
+    end_us = g_tx_stats.t0 + (uint64_t)config->time * 1000000;
+
+    while (1)
+    {
+        now_us = time_us_64();
+
+        if ((config->amount != 0) ? (g_tx_stats.nb0 >= config->amount) : (now_us >= end_us))
+        {
+            break;
+        }
+
+        iperf_stats_update(&g_tx_stats, false);
+
+        // Paced over the whole test, so a late datagram is caught up
+        if (g_tx_stats.nb0 * 8 * 1000000 >= (uint64_t)bandwidth * (now_us - g_tx_stats.t0) ||
+            getSn_TX_FSR(g_sn_client) < len)
+        {
+            continue;
+        }
+
+        iperf2_put_u32(g_iperf_buf, (uint32_t)id);
+        iperf2_put_u32(g_iperf_buf + 4, (uint32_t)(now_us / 1000000));
+        iperf2_put_u32(g_iperf_buf + 8, (uint32_t)(now_us % 1000000));
+
+        send_iperf(g_sn_client, g_iperf_buf, len);
+        iperf_stats_add_bytes(&g_tx_stats, len);
+        id++;
+    }
+
+    iperf_stats_update(&g_tx_stats, true);
+    iperf_stats_stop(&g_tx_stats);
+
+    result->seconds = (g_tx_stats.t3 - g_tx_stats.t0) / 1e6;
+    result->bytes = g_tx_stats.nb0;
+    result->datagrams = (uint32_t)id;
+
+    // The final datagram carries minus the next id, it is repeated until the server report arrives
+    for (uint8_t i = 0; i < IPERF2_CLIENT_FIN_TRIES && !result->report; i++)
+    {
+        now_us = time_us_64();
+
+        iperf2_put_u32(g_iperf_buf, (uint32_t)(-id));
+        iperf2_put_u32(g_iperf_buf + 4, (uint32_t)(now_us / 1000000));
+        iperf2_put_u32(g_iperf_buf + 8, (uint32_t)(now_us % 1000000));
+
+        send_iperf(g_sn_client, g_iperf_buf, len);
+        while (!send_iperf_flush(g_sn_client))
+            ;
+
+        while (!result->report && time_us_64() < now_us + IPERF2_CLIENT_FIN_WAIT_US)
+        {
+            if (getSn_RX_RSR(g_sn_client) == 0)
+            {
+                continue;
+            }
+
+            received = recvfrom(g_sn_client, g_iperf_buf, sizeof(g_iperf_buf), ip, &port);
+            if (received >= IPERF2_UDP_HDR_SIZE + IPERF2_SERVER_HDR_SIZE && (int32_t)iperf2_get_u32(g_iperf_buf) < 0)
+            {
+                iperf2_client_report(g_iperf_buf + IPERF2_UDP_HDR_SIZE, result);
+            }
+        }
+    }
+
+    close(g_sn_client);
+
+    if (!result->report)
+    {
+        printf("[iperf] No server report after %d tries\n", IPERF2_CLIENT_FIN_TRIES);
+        return -1;
+    }
+
+    result->ok = true;
+
+    printf("[iperf] Server Report: %llu Bytes in %.2f sec, %.2f Mbits/sec, jitter %.3f ms, %u/%u (%.2f%%) lost, %u out of order\n",
+           (unsigned long long)result->server_bytes, result->server_seconds,
+           result->server_seconds > 0 ? result->server_bytes * 8 / 1e6 / result->server_seconds : 0.0,
+           result->jitter_ms, result->errors, result->server_datagrams,
+           result->server_datagrams ? 100.0 * result->errors / result->server_datagrams : 0.0, result->outorder);
+
+    return 0;
+}
+
+/* Server report, after the header of the answer to the final datagram */
+static void iperf2_client_report(const uint8_t *hdr, iperf2_client_result_t *result)
+{
+    if ((iperf2_get_u32(hdr) & IPERF2_SERVER_HDR_VERSION1) == 0)
+    {
+        return;
+    }
+
+    result->report = true;
+    result->server_bytes = ((uint64_t)iperf2_get_u32(hdr + 4) << 32) | iperf2_get_u32(hdr + 8);
+    result->server_seconds = iperf2_get_u32(hdr + 12) + iperf2_get_u32(hdr + 16) / 1e6;
+    result->errors = iperf2_get_u32(hdr + 20);
+    result->outorder = iperf2_get_u32(hdr + 24);
+    result->server_datagrams = iperf2_get_u32(hdr + 28);
+    result->jitter_ms = iperf2_get_u32(hdr + 32) * 1000.0 + iperf2_get_u32(hdr + 36) / 1000.0;
+}
+
+/* UDP */
+void iperf2_udp_server_initialize(uint8_t sn, uint16_t port)
+{
+    g_udp_sn = sn;
+    g_udp_port = port;
+
+    iperf_stats_init(&g_udp_stats, 1000);
+    g_udp_stats.interval_report = true;
+
+    socket(g_udp_sn, Sn_MR_UDP, g_udp_port, 0x00);
+
+    printf("[iperf] Server listening on UDP port %d\n", g_udp_port);
+}
+
+void iperf2_udp_server_process(void)
+{
+    uint8_t ip[4] = {0};
+    uint16_t port = 0;
+    int32_t len = 0;
+    int32_t id = 0;
+
+    if (getSn_SR(g_udp_sn) == SOCK_CLOSED)
+    {
+        socket(g_udp_sn, Sn_MR_UDP, g_udp_port, 0x00);
+    }
+
+    while (getSn_RX_RSR(g_udp_sn) > 0)
+    {
+        len = recvfrom(g_udp_sn, g_iperf_buf, sizeof(g_iperf_buf), ip, &port);
+        if (len < IPERF2_UDP_HDR_SIZE)
+        {
+            continue;
+        }
+
+        id = (int32_t)iperf2_get_u32(g_iperf_buf);
+
+        if (g_udp_active && (memcmp(ip, g_udp_peer_ip, 4) != 0 || port != g_udp_peer_port))
+        {
+            // One client at a time, other datagrams are ignored until the test ends
+            continue;
+        }
+
+        if (id < 0)
+        {
+            // The client repeats its final datagram until the report arrives, every copy is answered
+            if (g_udp_active)
+            {
+                iperf2_udp_account(g_iperf_buf, (uint16_t)len, time_us_64());
+                iperf2_udp_stop();
+            }
+
+            if (memcmp(ip, g_udp_peer_ip, 4) == 0 && port == g_udp_peer_port)
+            {
+                iperf2_udp_report(g_iperf_buf, (uint16_t)len);
+            }
+            continue;
+        }
+
+        if (!g_udp_active)
+        {
+            iperf2_udp_start(ip, port, id);
+        }
+
+        iperf2_udp_account(g_iperf_buf, (uint16_t)len, time_us_64());
+    }
+
+    iperf_stats_update(&g_udp_stats, false);
+}
+
+static void iperf2_udp_start(const uint8_t *ip, uint16_t port, int32_t id)
+{
+    memcpy(g_udp_peer_ip, ip, 4);
+    g_udp_peer_port = port;
+
+    g_udp_active = true;
+    // Client versions number the first datagram 0 or 1, the first one received is the reference
+    g_udp_first_id = id;
+    g_udp_last_id = id - 1;
+    g_udp_errors = 0;
+    g_udp_outorder = 0;
+    iperf_jitter_init(&g_udp_jitter);
+    g_udp_first_us = time_us_64();
+    g_udp_last_us = g_udp_first_us;
+
+    printf("[iperf] Receiving UDP from %d.%d.%d.%d:%d\n", ip[0], ip[1], ip[2], ip[3], port);
+
+    iperf_stats_start(&g_udp_stats);
+}
+
+static void iperf2_udp_account(const uint8_t *buf, uint16_t len, uint64_t now_us)
+{
+    int32_t id = (int32_t)iperf2_get_u32(buf);
+    uint32_t sec = iperf2_get_u32(buf + 4);
+    uint32_t usec = iperf2_get_u32(buf + 8);
+    bool fin = (id < 0);
+
+    // The final datagram carries minus the id of the last one
+    if (fin)
+    {
+        id = -id;
+    }
+
+    // Loss and reordering, counted like the iperf2 server does
+    if (id != g_udp_last_id + 1)
+    {
+        if (id < g_udp_last_id + 1)
+        {
+            g_udp_outorder++;
+        }
+        else
+        {
+            g_udp_errors += id - g_udp_last_id - 1;
+        }
+    }
+    if (id > g_udp_last_id)
+    {
+        g_udp_last_id = id;
+    }
+
+    iperf_jitter_update(&g_udp_jitter, (uint32_t)now_us, sec, usec);
+
+    g_udp_last_us = now_us;
+
+    // The final datagram only marks the end, its bytes are not test data
+    if (!fin)
+    {
+        iperf_stats_add_bytes(&g_udp_stats, len);
+    }
+}
+
+static void iperf2_udp_stop(void)
+{
+    uint32_t datagrams = iperf2_udp_datagrams();
+
+    g_udp_active = false;
+
+    // A late datagram was first counted as lost
+    if (g_udp_errors > g_udp_outorder)
+    {
+        g_udp_errors -= g_udp_outorder;
+    }
+
+    iperf_stats_update(&g_udp_stats, true);
+    iperf_stats_stop(&g_udp_stats);
+
+    printf("[iperf] %u/%u datagrams lost (%.2f%%), %u out of order, jitter %.3f ms\n",
+           g_udp_errors, datagrams, datagrams ? 100.0 * g_udp_errors / datagrams : 0.0,
+           g_udp_outorder, g_udp_jitter.jitter_x16 / 16 / 1000.0);
+}
+
+/* Datagrams sent by the client, the final one numbers one past the last */
+static uint32_t iperf2_udp_datagrams(void)
+{
+    return (uint32_t)(g_udp_last_id - g_udp_first_id);
+}
+
+/* Server report, written after the header of the final datagram and sent back to the client */
+static void iperf2_udp_report(uint8_t *buf, uint16_t len)
+{
+    uint8_t *hdr = buf + IPERF2_UDP_HDR_SIZE;
+    uint64_t duration_us = g_udp_last_us - g_udp_first_us;
+    uint64_t bytes = g_udp_stats.nb0;
+    uint32_t jitter_us = g_udp_jitter.jitter_x16 / 16;
+
+    if (len < IPERF2_UDP_HDR_SIZE + IPERF2_SERVER_HDR_SIZE)
+    {
+        len = IPERF2_UDP_HDR_SIZE + IPERF2_SERVER_HDR_SIZE;
+    }
+
+    iperf2_put_u32(hdr, IPERF2_SERVER_HDR_VERSION1);
+    iperf2_put_u32(hdr + 4, (uint32_t)(bytes >> 32));
+    iperf2_put_u32(hdr + 8, (uint32_t)bytes);
+    iperf2_put_u32(hdr + 12, (uint32_t)(duration_us / 1000000));
+    iperf2_put_u32(hdr + 16, (uint32_t)(duration_us % 1000000));
+    iperf2_put_u32(hdr + 20, g_udp_errors);
+    iperf2_put_u32(hdr + 24, g_udp_outorder);
+    iperf2_put_u32(hdr + 28, iperf2_udp_datagrams());
+    iperf2_put_u32(hdr + 32, jitter_us / 1000000);
+    iperf2_put_u32(hdr + 36, jitter_us % 1000000);
+
+    sendto(g_udp_sn, buf, len, g_udp_peer_ip, g_udp_peer_port);
+}
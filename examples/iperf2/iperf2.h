@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _IPERF2_H_
+#define _IPERF2_H_
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Listener pool */
+#define IPERF2_MAX_CONNECTIONS 4
+
+/* Client header flags */
+#define IPERF2_HEADER_VERSION1 0x80000000 // Dual (-d) or tradeoff (-r) test, the header is valid
+#define IPERF2_RUN_NOW 0x00000001         // Dual test, the reverse test runs at the same time
+
+/* Client header size */
+#define IPERF2_CLIENT_HDR_SIZE 24
+
+/* UDP datagram header (id, sec, usec) and server report sizes */
+#define IPERF2_UDP_HDR_SIZE 12
+#define IPERF2_SERVER_HDR_SIZE 40
+
+/* Client defaults, the same as the iperf2 client */
+#define IPERF2_CLIENT_UDP_LEN 1470
+#define IPERF2_CLIENT_UDP_BANDWIDTH (1024 * 1024)
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* iperf2 client header, sent in network byte order at the start of a TCP test */
+typedef struct
+{
+    uint32_t flags;       // IPERF2_HEADER_VERSION1, IPERF2_RUN_NOW
+    int32_t num_threads;  // Parallel streams of the reverse test
+    uint32_t port;        // Port the client listens on for the reverse test
+    uint32_t buffer_len;  // Write size of the reverse test, 0 for the default
+    uint32_t win_band;    // TCP window or UDP bandwidth
+    int32_t amount;       // Bytes to send, or -(time in 10 ms units)
+} iperf2_client_hdr_t;
+
+/* Test to run, the options of the iperf2 client with the same meaning */
+typedef struct
+{
+    uint8_t server_ip[4]; // -c
+    uint16_t port;        // -p
+    bool udp;             // -u
+    uint16_t len;         // -l, 0 for the default
+    uint32_t bandwidth;   // -b in bits/sec, 0 for unlimited TCP or IPERF2_CLIENT_UDP_BANDWIDTH UDP
+    uint16_t time;        // -t in seconds
+    uint32_t amount;      // -n in bytes, 0 for a timed test
+} iperf2_client_config_t;
+
+/* Results of a test, the server's view comes from the UDP server report */
+typedef struct
+{
+    bool ok;                   // The test ran to its end
+    double seconds;            // Test duration on the device
+    uint64_t bytes;            // Bytes sent
+    uint32_t datagrams;        // UDP datagrams sent
+    bool report;               // The UDP server report arrived
+    uint64_t server_bytes;     // Bytes received by the server
+    double server_seconds;     // Test duration on the server
+    uint32_t errors;           // Datagrams lost
+    uint32_t outorder;         // Datagrams out of order
+    uint32_t server_datagrams; // Datagrams counted by the server
+    double jitter_ms;          // Jitter measured by the server
+} iperf2_client_result_t;
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/*! \brief Initialize iperf2 server
+ *  \ingroup iperf2
+ *
+ *  Open the iperf2 TCP server on a pool of W5x00 sockets, all listening on the same port,
+ *  so parallel streams (-P) are accepted. Each connection has its own statistics and its socket
+ *  goes back to LISTEN when it closes. Between tests, the socket buffer memory is shared out
+ *  again for the number of connections of the last test.
+ *  The reverse test of a dual (-d) or tradeoff (-r) test connects back to the client from sn_client.
+ *
+ *  \param sn_first first socket number of the pool
+ *  \param num_sockets number of sockets of the pool, up to IPERF2_MAX_CONNECTIONS
+ *  \param sn_client socket number of the reverse test
+ *  \param port iperf2 server port
+ */
+void iperf2_server_initialize(uint8_t sn_first, uint8_t num_sockets, uint8_t sn_client, uint16_t port);
+
+/*! \brief Run iperf2 server
+ *  \ingroup iperf2
+ *
+ *  Accept tests, receive and send data and print the interval and total reports.
+ *  It must be called periodically from the main loop.
+ *
+ *  \param none
+ */
+void iperf2_server_process(void);
+
+/*! \brief Initialize iperf2 UDP server
+ *  \ingroup iperf2
+ *
+ *  Open the iperf2 UDP server (iperf -s -u) on a W5x00 UDP socket.
+ *  Loss, out-of-order datagrams and jitter are counted from the datagram headers, and the
+ *  server report is sent back to the client when its final datagram arrives.
+ *
+ *  \param sn socket number of the server
+ *  \param port iperf2 server port
+ */
+void iperf2_udp_server_initialize(uint8_t sn, uint16_t port);
+
+/*! \brief Run iperf2 UDP server
+ *  \ingroup iperf2
+ *
+ *  Receive datagrams and print the interval and total reports.
+ *  It must be called periodically from the main loop.
+ *
+ *  \param none
+ */
+void iperf2_udp_server_process(void);
+
+/*! \brief Initialize iperf2 client
+ *  \ingroup iperf2
+ *
+ *  Use a W5x00 socket as the iperf2 client (iperf -c). The socket gets all of the TX buffer memory,
+ *  so the other sockets can not send.
+ *
+ *  \param sn socket number of the client
+ */
+void iperf2_client_initialize(uint8_t sn);
+
+/*! \brief Run one iperf2 test as the client
+ *  \ingroup iperf2
+ *
+ *  Send the client header and the data of the test to an iperf2 server, for the test time or amount,
+ *  paced to the bandwidth if one is set. The data goes through send_iperf, so writing the next data
+ *  overlaps the transmission of the last one. A UDP test ends with the final datagram, repeated until
+ *  the server report arrives. It returns when the test is over.
+ *
+ *  \param config test to run
+ *  \param result the results of the device and, for UDP, of the server
+ *  \return 0 if the test completed, -1 otherwise
+ */
+int8_t iperf2_client_run(const iperf2_client_config_t *config, iperf2_client_result_t *result);
+
+#endif /* _IPERF2_H_ */
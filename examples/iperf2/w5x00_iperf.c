@@ -18,6 +18,8 @@
 
 #include "socket.h"
 
+#include "iperf2.h"
+
 /**
  * ----------------------------------------------------------------------------------------------------
  * Macros
@@ -27,11 +29,21 @@
 // #define PLL_SYS_KHZ (133 * 1000)
 #define PLL_SYS_KHZ (90 * 1000)
 
-/* Buffer */
-#define ETHERNET_BUF_MAX_SIZE (1024 * 16)
+/* Protocol, uncomment to run the UDP server (iperf -s -u) instead of the TCP server */
+// #define IPERF_UDP
+
+/* Client mode, uncomment to send to an iperf2 server (iperf -c) instead of running the server */
+// #define IPERF_CLIENT
+#define IPERF_CLIENT_INTERVAL_MS (1000 * 10)
 
-/* Socket */
+/* Socket, the TCP listener pool is SOCKET_IPERF to SOCKET_IPERF + SOCKET_IPERF_NUM - 1 */
 #define SOCKET_IPERF 0
+#if (_WIZCHIP_ == W5100S)
+#define SOCKET_IPERF_NUM 2
+#else
+#define SOCKET_IPERF_NUM 4
+#endif
+#define SOCKET_IPERF_CLIENT (SOCKET_IPERF + SOCKET_IPERF_NUM) // Reverse test of the dual (-d) and tradeoff (-r) modes
 
 /* Port */
 #define PORT_IPERF 5001
@@ -52,10 +64,24 @@ static wiz_NetInfo g_net_info =
         .dhcp = NETINFO_STATIC                       // DHCP enable/disable
 };
 
-/* iperf */
-static uint8_t g_iperf_buf[ETHERNET_BUF_MAX_SIZE * 2] = {
-    0,
+#ifdef IPERF_CLIENT
+/* iperf client, same options as 'iperf -c 192.168.11.100 -t 10' */
+static iperf2_client_config_t g_client_config =
+    {
+        .server_ip = {192, 168, 11, 100}, // -c
+        .port = PORT_IPERF,               // -p
+#ifdef IPERF_UDP
+        .udp = true,                      // -u
+#else
+        .udp = false,                     // -u
+#endif
+        .len = 0,                         // -l, 0 for the default
+        .bandwidth = 0,                   // -b in bits/sec, 0 for unlimited TCP or 1 Mbits/sec UDP
+        .time = 10,                       // -t
+        .amount = 0,                      // -n in bytes, 0 for a timed test
 };
+static iperf2_client_result_t g_client_result;
+#endif
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -72,10 +98,6 @@ static void set_clock_khz(void);
  */
 int main()
 {
-    /* Initialize */
-    int retval = 0;
-    uint32_t pack_len = 0;
-
     set_clock_khz();
 
     stdio_init_all();
@@ -91,33 +113,31 @@ int main()
 
     /* Get network information */
     print_network_information(g_net_info);
+
+#if defined(IPERF_CLIENT)
+    iperf2_client_initialize(SOCKET_IPERF);
+
+    while (1)
+    {
+        iperf2_client_run(&g_client_config, &g_client_result);
+
+        sleep_ms(IPERF_CLIENT_INTERVAL_MS);
+    }
+#elif defined(IPERF_UDP)
+    iperf2_udp_server_initialize(SOCKET_IPERF, PORT_IPERF);
+
+    while (1)
+    {
+        iperf2_udp_server_process();
+    }
+#else
+    iperf2_server_initialize(SOCKET_IPERF, SOCKET_IPERF_NUM, SOCKET_IPERF_CLIENT, PORT_IPERF);
+
     while (1)
     {
-        switch(getSn_SR(SOCKET_IPERF))
-        {
-            case SOCK_ESTABLISHED :
-                while(1)
-                {
-
-                    getsockopt(SOCKET_IPERF, SO_RECVBUF, &pack_len);
-                    if (pack_len > 0)
-                    {
-                        recv_iperf(SOCKET_IPERF, (uint8_t *)g_iperf_buf, ETHERNET_BUF_MAX_SIZE / 2);
-                    }  
-                }
-            case SOCK_CLOSE_WAIT :
-                disconnect(SOCKET_IPERF);
-                break;
-            case SOCK_INIT :
-                listen(SOCKET_IPERF);
-                break;
-            case SOCK_CLOSED:
-                socket(SOCKET_IPERF, Sn_MR_TCP, PORT_IPERF, 0x00);
-                break;
-            default:
-                break;
-        }
+        iperf2_server_process();
     }
+#endif
 }
 
 
@@ -3,17 +3,29 @@
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
+#include "pico/time.h"
 #include "iperf.h"
 
-uint32_t get_time_us()
+uint64_t get_time_us()
 {
-    return (uint32_t)time_us_64();
+    return time_us_64();
+}
+
+static const char *stats_label(Stats *stats)
+{
+    return stats->label != NULL ? stats->label : "";
 }
 
 void iperf_stats_init(Stats *stats, uint32_t pacing_timer_ms)
 {
     stats->pacing_timer_us = pacing_timer_ms * 1000;
     stats->running = false;
+#ifdef IPERF_DEBUG
+    stats->interval_report = true;
+#else
+    stats->interval_report = false;
+#endif
+    stats->label = NULL;
     stats->t0 = 0;
     stats->t1 = 0;
     stats->t3 = 0;
@@ -29,25 +41,25 @@ void iperf_stats_start(Stats *stats)
     stats->t0 = stats->t1 = get_time_us();
     stats->nb0 = stats->nb1 = 0;
     stats->np0 = stats->np1 = 0;
-    printf("Interval           Transfer     Bitrate\n");
+    printf("%sInterval           Transfer     Bitrate\n", stats_label(stats));
 }
 
 void iperf_stats_update(Stats *stats, bool final)
 {
     if (!stats->running) return;
 
-    uint32_t t2 = get_time_us();
-    uint32_t dt = t2 - stats->t1;  // Elapsed time since last update
+    uint64_t t2 = get_time_us();
+    uint64_t dt = t2 - stats->t1;  // Elapsed time since last update
 
     if (final || dt > stats->pacing_timer_us) {
         double ta = (stats->t1 - stats->t0) / 1e6;  // Start time of the previous interval
         double tb = (t2 - stats->t0) / 1e6;         // End time of the current interval
         double transfer_mbits = (stats->nb1 * 8) / 1e6 / (dt / 1e6);  // Calculate Mbps
 
-#ifdef IPERF_DEBUG
-        printf("%5.2f-%-5.2f sec %8u Bytes  %5.2f Mbits/sec\n",
-               ta, tb, stats->nb1, transfer_mbits);
-#endif
+        if (stats->interval_report && dt > 0) {
+            printf("%s%5.2f-%-5.2f sec %8llu Bytes  %5.2f Mbits/sec\n",
+                   stats_label(stats), ta, tb, (unsigned long long)stats->nb1, transfer_mbits);
+        }
 
         stats->t1 = t2;  // Update the timer
         stats->nb1 = 0;  // Reset byte count per interval
@@ -60,13 +72,15 @@ void iperf_stats_stop(Stats *stats)
     stats->running = false;
 
     stats->t3 = get_time_us();
-    uint32_t total_time_us = stats->t3 - stats->t0;
+    uint64_t total_time_us = stats->t3 - stats->t0;
     double total_time_s = total_time_us / 1e6;
     double transfer_mbits = (stats->nb0 * 8) / 1e6 / total_time_s;
+    double packets_per_sec = stats->np0 / total_time_s;
 
-    printf("------------------------------------------------------------\n");
-    printf("Total: %5.2f sec %8u Bytes  %5.2f Mbits/sec\n",
-           total_time_s, stats->nb0, transfer_mbits);
+    printf("%s------------------------------------------------------------\n", stats_label(stats));
+    printf("%sTotal: %5.2f sec %8llu Bytes  %5.2f Mbits/sec  %8llu Packets  %7.0f Packets/sec\n",
+           stats_label(stats), total_time_s, (unsigned long long)stats->nb0, transfer_mbits,
+           (unsigned long long)stats->np0, packets_per_sec);
 }
 
 void iperf_stats_add_bytes(Stats *stats, uint32_t n) {
@@ -77,4 +91,30 @@ void iperf_stats_add_bytes(Stats *stats, uint32_t n) {
     stats->np0 += 1;  // Increase total packet count
     stats->np1 += 1;  // Increase packet count per interval
 
-}
\ No newline at end of file
+}
+
+void iperf_jitter_init(Jitter *jitter)
+{
+    jitter->jitter_x16 = 0;
+    jitter->prev_transit = 0;
+    jitter->has_transit = false;
+}
+
+// RFC 1889 jitter of a datagram sent at sec.usec and received at now_us.
+// Only differences of transit times are used, so the offset between the two clocks cancels out.
+void iperf_jitter_update(Jitter *jitter, uint32_t now_us, uint32_t sec, uint32_t usec)
+{
+    uint32_t transit = now_us - (sec * 1000000 + usec);
+    int32_t d = 0;
+
+    if (jitter->has_transit) {
+        d = (int32_t)(transit - jitter->prev_transit);
+        if (d < 0) {
+            d = -d;
+        }
+        jitter->jitter_x16 += d - (jitter->jitter_x16 >> 4);
+    }
+
+    jitter->prev_transit = transit;
+    jitter->has_transit = true;
+}
@@ -1,3 +1,6 @@
+#ifndef _IPERF_H_
+#define _IPERF_H_
+
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -7,17 +10,30 @@
 typedef struct {
     uint32_t pacing_timer_us;  // Timer period (in microseconds)
     bool running;              // Execution flag (indicates whether stats tracking is active)
-    uint32_t t0;               // Test start time
-    uint32_t t1;               // Last update time
-    uint32_t t3;               // Test end time
-    uint32_t nb0;              // Total number of bytes
-    uint32_t nb1;              // Number of bytes per interval
-    uint32_t np0;              // Total number of packets
-    uint32_t np1;              // Number of packets per interval
+    bool interval_report;      // Print a line per interval (always on with IPERF_DEBUG)
+    const char *label;         // Prefix of the printed lines, or NULL
+    uint64_t t0;               // Test start time
+    uint64_t t1;               // Last update time
+    uint64_t t3;               // Test end time
+    uint64_t nb0;              // Total number of bytes
+    uint64_t nb1;              // Number of bytes per interval
+    uint64_t np0;              // Total number of packets
+    uint64_t np1;              // Number of packets per interval
 } Stats;
 
+typedef struct {
+    uint32_t jitter_x16;       // RFC 1889 jitter in microseconds, times 16
+    uint32_t prev_transit;     // Transit time of the previous datagram (in microseconds)
+    bool has_transit;          // A datagram was received since the last init
+} Jitter;
+
 void iperf_stats_init(Stats *stats, uint32_t pacing_timer_ms);
 void iperf_stats_start(Stats *stats);
 void iperf_stats_update(Stats *stats, bool final);
 void iperf_stats_stop(Stats *stats);
-void iperf_stats_add_bytes(Stats *stats, uint32_t n);
\ No newline at end of file
+void iperf_stats_add_bytes(Stats *stats, uint32_t n);
+
+void iperf_jitter_init(Jitter *jitter);
+void iperf_jitter_update(Jitter *jitter, uint32_t now_us, uint32_t sec, uint32_t usec);
+
+#endif /* _IPERF_H_ */
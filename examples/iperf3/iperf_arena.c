@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <stddef.h>
+
+#include "cJSON.h" // JSON handling library
+#include "iperf.h"
+#include "iperf_arena.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Alignment of every allocation, enough for the doubles of cJSON */
+#define ARENA_ALIGN 8
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Arena */
+static uint64_t g_arena[IPERF_ARENA_SIZE / sizeof(uint64_t)];
+static uint32_t g_arena_top = 0;
+static uint32_t g_arena_last = 0; // Offset of the last allocation, freeing it gives its space back
+
+/* Statistics */
+static uint32_t g_arena_high_water = 0;
+static uint32_t g_arena_failures = 0;
+static uint32_t g_arena_reported = 0; // Failures already printed
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+static void *iperf_arena_malloc(size_t size);
+static void iperf_arena_free(void *ptr);
+
+void iperf_arena_initialize(void)
+{
+    cJSON_Hooks hooks = {
+        .malloc_fn = iperf_arena_malloc,
+        .free_fn = iperf_arena_free,
+    };
+
+    cJSON_InitHooks(&hooks);
+
+    g_arena_top = 0;
+    g_arena_last = 0;
+    g_arena_high_water = 0;
+    g_arena_failures = 0;
+    g_arena_reported = 0;
+}
+
+void iperf_arena_reset(void)
+{
+#ifdef IPERF_DEBUG
+    printf("[iperf] JSON arena : %u of %u bytes used, %u at most\n", g_arena_top, IPERF_ARENA_SIZE, g_arena_high_water);
+#endif
+
+    if (g_arena_failures != g_arena_reported)
+    {
+        printf("[iperf] JSON arena of %u bytes exhausted, %u allocations failed\n",
+               IPERF_ARENA_SIZE, g_arena_failures - g_arena_reported);
+        g_arena_reported = g_arena_failures;
+    }
+
+    g_arena_top = 0;
+    g_arena_last = 0;
+}
+
+uint32_t iperf_arena_high_water(void)
+{
+    return g_arena_high_water;
+}
+
+uint32_t iperf_arena_failures(void)
+{
+    return g_arena_failures;
+}
+
+static void *iperf_arena_malloc(size_t size)
+{
+    size_t aligned = 0;
+
+    // Checked before rounding, a size near SIZE_MAX would round to 0. The top stays aligned, so the rounded size fits too
+    if (size == 0 || size > sizeof(g_arena) - g_arena_top)
+    {
+        g_arena_failures++;
+        return NULL;
+    }
+
+    aligned = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    g_arena_last = g_arena_top;
+    g_arena_top += aligned;
+
+    if (g_arena_top > g_arena_high_water)
+    {
+        g_arena_high_water = g_arena_top;
+    }
+
+    return (uint8_t *)g_arena + g_arena_last;
+}
+
+/* Only the last allocation is given back, the rest waits for iperf_arena_reset */
+static void iperf_arena_free(void *ptr)
+{
+    if (ptr != NULL && ptr == (uint8_t *)g_arena + g_arena_last && g_arena_last < g_arena_top)
+    {
+        g_arena_top = g_arena_last;
+    }
+}
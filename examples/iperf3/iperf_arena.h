@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _IPERF_ARENA_H_
+#define _IPERF_ARENA_H_
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdint.h>
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Arena size, the JSON of one test must fit in it */
+#ifndef IPERF_ARENA_SIZE
+#define IPERF_ARENA_SIZE (1024 * 8)
+#endif
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/*! \brief Initialize JSON arena
+ *  \ingroup iperf_arena
+ *
+ *  Hook cJSON to a static arena of IPERF_ARENA_SIZE bytes with cJSON_InitHooks,
+ *  so cJSON never allocates from the heap. Allocations are taken in order from the arena
+ *  and freed all at once with iperf_arena_reset. When the arena is exhausted,
+ *  allocations fail and cJSON returns NULL.
+ *
+ *  \param none
+ */
+void iperf_arena_initialize(void);
+
+/*! \brief Free the JSON arena
+ *  \ingroup iperf_arena
+ *
+ *  Free everything allocated since the last reset, at the end of a test.
+ *  Nothing allocated from the arena may be used afterwards.
+ *
+ *  \param none
+ */
+void iperf_arena_reset(void);
+
+/*! \brief Get the high-water mark of the JSON arena
+ *  \ingroup iperf_arena
+ *
+ *  \param none
+ *  \return largest number of bytes in use since the arena was initialized
+ */
+uint32_t iperf_arena_high_water(void);
+
+/*! \brief Get the failed allocations of the JSON arena
+ *  \ingroup iperf_arena
+ *
+ *  \param none
+ *  \return number of allocations that did not fit since the arena was initialized
+ */
+uint32_t iperf_arena_failures(void);
+
+#endif /* _IPERF_ARENA_H_ */
@@ -0,0 +1,300 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <string.h>
+
+#include "iperf_json.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+static void iperf_json_put(iperf_json_t *json, const char *data, uint32_t len);
+static void iperf_json_key(iperf_json_t *json, const char *key);
+static uint8_t iperf_json_utoa(char *out, uint64_t value);
+
+void iperf_json_init(iperf_json_t *json, char *buf, uint32_t size, iperf_json_sink_t sink, void *arg)
+{
+    memset(json, 0, sizeof(iperf_json_t));
+    json->buf = buf;
+    json->size = (buf != NULL) ? size : 0;
+    json->sink = sink;
+    json->arg = arg;
+}
+
+int32_t iperf_json_finish(iperf_json_t *json)
+{
+    if (json->sink != NULL)
+    {
+        if (json->len > 0)
+        {
+            json->sink(json->arg, json->buf, json->len);
+            json->len = 0;
+        }
+    }
+    else if (json->buf != NULL)
+    {
+        if (json->len < json->size)
+        {
+            json->buf[json->len] = '\0';
+        }
+        else
+        {
+            json->overflow = true;
+        }
+    }
+
+    return json->overflow ? -1 : (int32_t)json->total;
+}
+
+void iperf_json_object_begin(iperf_json_t *json, const char *key)
+{
+    iperf_json_key(json, key);
+    iperf_json_put(json, "{", 1);
+
+    json->depth++;
+    json->members &= ~(1UL << (json->depth % IPERF_JSON_MAX_DEPTH));
+}
+
+void iperf_json_object_end(iperf_json_t *json)
+{
+    json->depth--;
+    iperf_json_put(json, "}", 1);
+}
+
+void iperf_json_array_begin(iperf_json_t *json, const char *key)
+{
+    iperf_json_key(json, key);
+    iperf_json_put(json, "[", 1);
+
+    json->depth++;
+    json->members &= ~(1UL << (json->depth % IPERF_JSON_MAX_DEPTH));
+}
+
+void iperf_json_array_end(iperf_json_t *json)
+{
+    json->depth--;
+    iperf_json_put(json, "]", 1);
+}
+
+void iperf_json_uint(iperf_json_t *json, const char *key, uint64_t value)
+{
+    char digits[20];
+    uint8_t len = iperf_json_utoa(digits, value);
+
+    iperf_json_key(json, key);
+    iperf_json_put(json, digits, len);
+}
+
+void iperf_json_int(iperf_json_t *json, const char *key, int64_t value)
+{
+    char digits[21];
+    uint8_t len = 0;
+
+    if (value < 0)
+    {
+        digits[0] = '-';
+        len = 1 + iperf_json_utoa(digits + 1, (uint64_t)(-(value + 1)) + 1);
+    }
+    else
+    {
+        len = iperf_json_utoa(digits, (uint64_t)value);
+    }
+
+    iperf_json_key(json, key);
+    iperf_json_put(json, digits, len);
+}
+
+void iperf_json_fixed(iperf_json_t *json, const char *key, uint64_t value, uint8_t decimals)
+{
+    char digits[40];
+    uint8_t len = iperf_json_utoa(digits + 20, value);
+    char *start = digits + 20;
+
+    // Leading zeros so there is at least one digit before the point
+    while (len <= decimals)
+    {
+        *--start = '0';
+        len++;
+    }
+
+    if (decimals > 0)
+    {
+        memmove(start - 1, start, len - decimals);
+        start[len - decimals - 1] = '.';
+        start--;
+        len++;
+    }
+
+    iperf_json_key(json, key);
+    iperf_json_put(json, start, len);
+}
+
+void iperf_json_bool(iperf_json_t *json, const char *key, bool value)
+{
+    iperf_json_key(json, key);
+
+    if (value)
+    {
+        iperf_json_put(json, "true", 4);
+    }
+    else
+    {
+        iperf_json_put(json, "false", 5);
+    }
+}
+
+/* Only strings of the program itself are written, they need no escaping */
+void iperf_json_string(iperf_json_t *json, const char *key, const char *value)
+{
+    iperf_json_key(json, key);
+    iperf_json_put(json, "\"", 1);
+    iperf_json_put(json, value, strlen(value));
+    iperf_json_put(json, "\"", 1);
+}
+
+void iperf_json_results(iperf_json_t *json, const iperf_json_stream_t *streams, uint8_t num_streams, int8_t sender_has_retransmits)
+{
+    iperf_json_object_begin(json, NULL);
+    iperf_json_uint(json, "cpu_util_total", 0);
+    iperf_json_uint(json, "cpu_util_user", 0);
+    iperf_json_uint(json, "cpu_util_system", 0);
+    iperf_json_int(json, "sender_has_retransmits", sender_has_retransmits);
+
+    iperf_json_array_begin(json, "streams");
+    for (uint8_t i = 0; i < num_streams; i++)
+    {
+        iperf_json_object_begin(json, NULL);
+        iperf_json_uint(json, "id", streams[i].id);
+        iperf_json_uint(json, "bytes", streams[i].bytes);
+        iperf_json_int(json, "retransmits", streams[i].retransmits);
+        iperf_json_fixed(json, "jitter", streams[i].jitter_us, 6);
+        iperf_json_uint(json, "errors", streams[i].errors);
+        iperf_json_uint(json, "packets", streams[i].packets);
+        iperf_json_fixed(json, "start_time", streams[i].start_us, 6);
+        iperf_json_fixed(json, "end_time", streams[i].end_us, 6);
+        iperf_json_object_end(json);
+    }
+    iperf_json_array_end(json);
+
+    iperf_json_object_end(json);
+}
+
+uint32_t iperf_json_send_results(const iperf_json_stream_t *streams, uint8_t num_streams, int8_t sender_has_retransmits,
+                                 iperf_json_sink_t sink, void *arg)
+{
+    char chunk[IPERF_JSON_CHUNK_SIZE];
+    uint8_t length_bytes[4];
+    iperf_json_t json;
+    uint32_t len = 0;
+
+    // Count the length first, it is sent before the object
+    iperf_json_init(&json, NULL, 0, NULL, NULL);
+    iperf_json_results(&json, streams, num_streams, sender_has_retransmits);
+    len = (uint32_t)iperf_json_finish(&json);
+
+    length_bytes[0] = (len >> 24) & 0xFF;
+    length_bytes[1] = (len >> 16) & 0xFF;
+    length_bytes[2] = (len >> 8) & 0xFF;
+    length_bytes[3] = len & 0xFF;
+    sink(arg, length_bytes, 4);
+
+    iperf_json_init(&json, chunk, sizeof(chunk), sink, arg);
+    iperf_json_results(&json, streams, num_streams, sender_has_retransmits);
+    iperf_json_finish(&json);
+
+    return len;
+}
+
+static void iperf_json_put(iperf_json_t *json, const char *data, uint32_t len)
+{
+    uint32_t copy = 0;
+
+    json->total += len;
+
+    while (len > 0)
+    {
+        if (json->len == json->size)
+        {
+            if (json->sink == NULL || json->size == 0)
+            {
+                // Only counted, or the output does not fit in buf
+                json->overflow = json->overflow || (json->buf != NULL);
+                return;
+            }
+
+            json->sink(json->arg, json->buf, json->len);
+            json->len = 0;
+        }
+
+        copy = json->size - json->len;
+        if (copy > len)
+        {
+            copy = len;
+        }
+
+        memcpy(json->buf + json->len, data, copy);
+        json->len += copy;
+        data += copy;
+        len -= copy;
+    }
+}
+
+/* Separator from the previous member, then the key if there is one */
+static void iperf_json_key(iperf_json_t *json, const char *key)
+{
+    uint32_t bit = 1UL << (json->depth % IPERF_JSON_MAX_DEPTH);
+
+    if (json->depth > 0)
+    {
+        if (json->members & bit)
+        {
+            iperf_json_put(json, ",", 1);
+        }
+        json->members |= bit;
+    }
+
+    if (key != NULL)
+    {
+        iperf_json_put(json, "\"", 1);
+        iperf_json_put(json, key, strlen(key));
+        iperf_json_put(json, "\":", 2);
+    }
+}
+
+/* Decimal digits of value, the 32-bit division is used as soon as the value fits, the 64-bit one is a library call on the Cortex-M0+ */
+static uint8_t iperf_json_utoa(char *out, uint64_t value)
+{
+    char digits[20];
+    uint8_t len = 0;
+    uint32_t value32 = 0;
+
+    while (value > 0xFFFFFFFFULL)
+    {
+        digits[len++] = '0' + (char)(value % 10);
+        value /= 10;
+    }
+
+    value32 = (uint32_t)value;
+    do
+    {
+        digits[len++] = '0' + (char)(value32 % 10);
+        value32 /= 10;
+    } while (value32 > 0);
+
+    for (uint8_t i = 0; i < len; i++)
+    {
+        out[i] = digits[len - 1 - i];
+    }
+
+    return len;
+}
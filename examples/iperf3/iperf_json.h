@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _IPERF_JSON_H_
+#define _IPERF_JSON_H_
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Staging buffer of iperf_json_send_results, written to the sink each time it is full */
+#define IPERF_JSON_CHUNK_SIZE 256
+
+/* Nesting depth of objects and arrays */
+#define IPERF_JSON_MAX_DEPTH 32
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Output of the writer, for example the control connection */
+typedef void (*iperf_json_sink_t)(void *arg, const void *data, uint32_t len);
+
+/* JSON writer, the output goes to buf, or through buf to the sink */
+typedef struct
+{
+    char *buf;
+    uint32_t size;
+    uint32_t len;           // Bytes in buf
+    uint32_t total;         // Bytes written, including those already given to the sink
+    iperf_json_sink_t sink; // NULL to keep the output in buf
+    void *arg;
+    bool overflow;          // The output did not fit in buf
+    uint8_t depth;
+    uint32_t members;       // One bit per depth, set once the object or array has a member
+} iperf_json_t;
+
+/* Stream of the results */
+typedef struct
+{
+    uint8_t id;
+    uint64_t bytes;
+    int32_t retransmits; // -1 if unknown
+    uint32_t jitter_us;
+    uint32_t errors;
+    uint64_t packets;
+    uint64_t start_us;   // From the start of the test
+    uint64_t end_us;
+} iperf_json_stream_t;
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/*! \brief Initialize JSON writer
+ *  \ingroup iperf_json
+ *
+ *  Without a sink, the output is kept in buf and the writer only counts the bytes once buf is full.
+ *  With a sink, buf is a staging buffer given to the sink each time it is full and by iperf_json_finish.
+ *  With neither buf nor sink, the writer only counts the bytes.
+ *
+ *  \param json writer
+ *  \param buf output or staging buffer, or NULL
+ *  \param size size of buf
+ *  \param sink output, or NULL
+ *  \param arg argument of the sink
+ */
+void iperf_json_init(iperf_json_t *json, char *buf, uint32_t size, iperf_json_sink_t sink, void *arg);
+
+/*! \brief Finish JSON writer
+ *  \ingroup iperf_json
+ *
+ *  Give the rest of the output to the sink, or terminate the output in buf.
+ *
+ *  \param json writer
+ *  \return number of bytes written, -1 if the output did not fit in buf
+ */
+int32_t iperf_json_finish(iperf_json_t *json);
+
+/*! \brief Write JSON values
+ *  \ingroup iperf_json
+ *
+ *  Each value is a member of the enclosing object when key is not NULL, and an element of the
+ *  enclosing array or the top-level value otherwise. Numbers are written with integer arithmetic only,
+ *  iperf_json_fixed writes value / 10^decimals with all its decimals.
+ */
+void iperf_json_object_begin(iperf_json_t *json, const char *key);
+void iperf_json_object_end(iperf_json_t *json);
+void iperf_json_array_begin(iperf_json_t *json, const char *key);
+void iperf_json_array_end(iperf_json_t *json);
+void iperf_json_uint(iperf_json_t *json, const char *key, uint64_t value);
+void iperf_json_int(iperf_json_t *json, const char *key, int64_t value);
+void iperf_json_fixed(iperf_json_t *json, const char *key, uint64_t value, uint8_t decimals);
+void iperf_json_bool(iperf_json_t *json, const char *key, bool value);
+void iperf_json_string(iperf_json_t *json, const char *key, const char *value);
+
+/*! \brief Write iperf3 results
+ *  \ingroup iperf_json
+ *
+ *  Write the results object of the iperf3 results exchange, with one entry per stream.
+ *
+ *  \param json writer
+ *  \param streams streams of the test
+ *  \param num_streams number of streams
+ *  \param sender_has_retransmits 1 if the retransmits are known, 0 if not, -1 for the receiving side
+ */
+void iperf_json_results(iperf_json_t *json, const iperf_json_stream_t *streams, uint8_t num_streams, int8_t sender_has_retransmits);
+
+/*! \brief Send iperf3 results
+ *  \ingroup iperf_json
+ *
+ *  Send the length in network byte order, then the results object, through the sink.
+ *  The length is counted in a first pass, then the object is written in chunks of
+ *  IPERF_JSON_CHUNK_SIZE bytes from the stack. Nothing is allocated.
+ *
+ *  \param streams streams of the test
+ *  \param num_streams number of streams
+ *  \param sender_has_retransmits 1 if the retransmits are known, 0 if not, -1 for the receiving side
+ *  \param sink output
+ *  \param arg argument of the sink
+ *  \return number of bytes of the results object
+ */
+uint32_t iperf_json_send_results(const iperf_json_stream_t *streams, uint8_t num_streams, int8_t sender_has_retransmits,
+                                 iperf_json_sink_t sink, void *arg);
+
+#endif /* _IPERF_JSON_H_ */
@@ -0,0 +1,515 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include "iperf_params.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Parser states */
+#define STATE_START 0
+#define STATE_KEY_OR_END 1 // After '{' or ','
+#define STATE_KEY 2
+#define STATE_COLON 3
+#define STATE_VALUE 4
+#define STATE_STRING 5
+#define STATE_NUMBER 6
+#define STATE_LITERAL 7
+#define STATE_SKIP 8       // Object or array of an unknown key
+#define STATE_AFTER 9      // After a value
+#define STATE_DONE 10
+#define STATE_ERROR 11
+
+/* Parser flags */
+#define FLAG_ESCAPE 0x01
+#define FLAG_NEGATIVE 0x02
+#define FLAG_FRACTION 0x04
+#define FLAG_EXPONENT 0x08
+#define FLAG_EXPONENT_NEGATIVE 0x10
+#define FLAG_SKIP_STRING 0x20
+
+/* Parameter types */
+#define TYPE_BOOL 0
+#define TYPE_U32 1
+#define TYPE_U64 2
+#define TYPE_STRING 3
+
+#define PARAM(name, key, type) {key, type, sizeof(((iperf_params_t *)0)->name), offsetof(iperf_params_t, name)}
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+typedef struct
+{
+    const char *key;
+    uint8_t type;
+    uint8_t size;
+    uint16_t offset;
+} iperf_param_t;
+
+/* Known parameters, in IPERF_PARAM_... order */
+static const iperf_param_t g_params[] = {
+    PARAM(tcp, "tcp", TYPE_BOOL),
+    PARAM(udp, "udp", TYPE_BOOL),
+    PARAM(reverse, "reverse", TYPE_BOOL),
+    PARAM(bidirectional, "bidirectional", TYPE_BOOL),
+    PARAM(nodelay, "nodelay", TYPE_BOOL),
+    PARAM(get_server_output, "get_server_output", TYPE_BOOL),
+    PARAM(udp_counters_64bit, "udp_counters_64bit", TYPE_BOOL),
+    PARAM(repeating_payload, "repeating_payload", TYPE_BOOL),
+    PARAM(zerocopy, "zerocopy", TYPE_BOOL),
+    PARAM(omit, "omit", TYPE_U32),
+    PARAM(time, "time", TYPE_U32),
+    PARAM(num, "num", TYPE_U64),
+    PARAM(blockcount, "blockcount", TYPE_U64),
+    PARAM(parallel, "parallel", TYPE_U32),
+    PARAM(len, "len", TYPE_U32),
+    PARAM(bandwidth, "bandwidth", TYPE_U64),
+    PARAM(fqrate, "fqrate", TYPE_U64),
+    PARAM(pacing_timer, "pacing_timer", TYPE_U32),
+    PARAM(burst, "burst", TYPE_U32),
+    PARAM(window, "window", TYPE_U32),
+    PARAM(mss, "MSS", TYPE_U32),
+    PARAM(tos, "TOS", TYPE_U32),
+    PARAM(client_version, "client_version", TYPE_STRING),
+};
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+static int8_t iperf_params_lookup(const char *key, uint8_t len);
+static void iperf_params_store(iperf_params_parser_t *parser, uint8_t type, bool value);
+
+void iperf_params_init(iperf_params_parser_t *parser, iperf_params_t *params)
+{
+    memset(parser, 0, sizeof(iperf_params_parser_t));
+    memset(params, 0, sizeof(iperf_params_t));
+
+    parser->params = params;
+    parser->state = STATE_START;
+    parser->param = -1;
+}
+
+void iperf_params_feed(iperf_params_parser_t *parser, const void *data, uint32_t len)
+{
+    const char *p = (const char *)data;
+    const char *end = p + len;
+    char *str = NULL;
+    char c = 0;
+
+    while (p < end)
+    {
+        c = *p;
+
+        switch (parser->state)
+        {
+        case STATE_START:
+            if (c == '{')
+            {
+                parser->state = STATE_KEY_OR_END;
+            }
+            else if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            {
+                parser->state = STATE_ERROR;
+            }
+            break;
+
+        case STATE_KEY_OR_END:
+            if (c == '"')
+            {
+                parser->key_len = 0;
+                parser->state = STATE_KEY;
+            }
+            else if (c == '}')
+            {
+                parser->state = STATE_DONE;
+            }
+            else if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            {
+                parser->state = STATE_ERROR;
+            }
+            break;
+
+        case STATE_KEY:
+            // Plain characters are copied without going back through the state machine
+            while (c != '"' && c != '\\' && !(parser->flags & FLAG_ESCAPE) && parser->key_len < IPERF_PARAMS_KEY_SIZE)
+            {
+                parser->key[parser->key_len++] = c;
+                if (++p == end)
+                {
+                    return;
+                }
+                c = *p;
+            }
+
+            if (parser->flags & FLAG_ESCAPE)
+            {
+                // Known keys have no escapes, the key only has to stay unknown
+                parser->flags &= ~FLAG_ESCAPE;
+                parser->key_len = IPERF_PARAMS_KEY_SIZE;
+            }
+            else if (c == '\\')
+            {
+                parser->flags |= FLAG_ESCAPE;
+            }
+            else if (c == '"')
+            {
+                parser->param = iperf_params_lookup(parser->key, parser->key_len);
+                parser->state = STATE_COLON;
+            }
+            else if (parser->key_len < IPERF_PARAMS_KEY_SIZE)
+            {
+                parser->key[parser->key_len++] = c;
+            }
+            break;
+
+        case STATE_COLON:
+            if (c == ':')
+            {
+                parser->state = STATE_VALUE;
+            }
+            else if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            {
+                parser->state = STATE_ERROR;
+            }
+            break;
+
+        case STATE_VALUE:
+            parser->flags = 0;
+            parser->number = 0;
+            parser->exponent = 0;
+            parser->fraction = 0;
+            parser->str_len = 0;
+
+            if (c == '"')
+            {
+                parser->state = STATE_STRING;
+            }
+            else if (c == '-' || (c >= '0' && c <= '9'))
+            {
+                parser->flags = (c == '-') ? FLAG_NEGATIVE : 0;
+                parser->number = (c == '-') ? 0 : (uint64_t)(c - '0');
+                parser->state = STATE_NUMBER;
+            }
+            else if (c == 't' || c == 'f' || c == 'n')
+            {
+                parser->literal = (c == 't') ? "true" : ((c == 'f') ? "false" : "null");
+                parser->str_len = 1;
+                parser->state = STATE_LITERAL;
+            }
+            else if (c == '{' || c == '[')
+            {
+                parser->depth = 1;
+                parser->state = STATE_SKIP;
+            }
+            else if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            {
+                parser->state = STATE_ERROR;
+            }
+            break;
+
+        case STATE_STRING:
+            str = NULL;
+            if (parser->param >= 0 && g_params[parser->param].type == TYPE_STRING)
+            {
+                str = (char *)parser->params + g_params[parser->param].offset;
+            }
+            else if (!(parser->flags & FLAG_ESCAPE))
+            {
+                // Strings of unknown keys, such as the title or extra data, are only scanned for their end
+                while (c != '"' && c != '\\')
+                {
+                    if (++p == end)
+                    {
+                        return;
+                    }
+                    c = *p;
+                }
+            }
+
+            if (!(parser->flags & FLAG_ESCAPE) && c == '\\')
+            {
+                parser->flags |= FLAG_ESCAPE;
+                break;
+            }
+
+            if (!(parser->flags & FLAG_ESCAPE) && c == '"')
+            {
+                if (str != NULL)
+                {
+                    str[parser->str_len] = '\0';
+                    parser->params->present |= 1UL << parser->param;
+                }
+                parser->state = STATE_AFTER;
+                break;
+            }
+
+            // Escaped characters are kept as they are, the known strings are plain text
+            parser->flags &= ~FLAG_ESCAPE;
+            if (str != NULL && parser->str_len < g_params[parser->param].size - 1)
+            {
+                str[parser->str_len++] = c;
+            }
+            break;
+
+        case STATE_NUMBER:
+            if (c >= '0' && c <= '9')
+            {
+                if (parser->flags & FLAG_EXPONENT)
+                {
+                    if (parser->exponent < 100)
+                    {
+                        parser->exponent = parser->exponent * 10 + (c - '0');
+                    }
+                }
+                else if (parser->number <= (UINT64_MAX - 9) / 10)
+                {
+                    parser->number = parser->number * 10 + (c - '0');
+                    parser->fraction += (parser->flags & FLAG_FRACTION) ? 1 : 0;
+                }
+                else if (!(parser->flags & FLAG_FRACTION))
+                {
+                    // Saturate instead of wrapping
+                    parser->number = UINT64_MAX;
+                }
+                break;
+            }
+            else if (c == '.')
+            {
+                parser->flags |= FLAG_FRACTION;
+                break;
+            }
+            else if (c == 'e' || c == 'E')
+            {
+                parser->flags |= FLAG_EXPONENT;
+                break;
+            }
+            else if ((c == '+' || c == '-') && (parser->flags & FLAG_EXPONENT))
+            {
+                parser->flags |= (c == '-') ? FLAG_EXPONENT_NEGATIVE : 0;
+                break;
+            }
+
+            // cJSON prints large numbers with an exponent, such as 1e+15, the fraction is dropped after scaling
+            if (parser->flags & FLAG_EXPONENT_NEGATIVE)
+            {
+                parser->exponent += parser->fraction;
+            }
+            else if (parser->exponent >= parser->fraction)
+            {
+                parser->exponent -= parser->fraction;
+            }
+            else
+            {
+                parser->exponent = parser->fraction - parser->exponent;
+                parser->flags |= FLAG_EXPONENT_NEGATIVE;
+            }
+
+            while (parser->exponent > 0 && parser->number > 0)
+            {
+                if (parser->flags & FLAG_EXPONENT_NEGATIVE)
+                {
+                    parser->number /= 10;
+                }
+                else if (parser->number != UINT64_MAX)
+                {
+                    parser->number = (parser->number > UINT64_MAX / 10) ? UINT64_MAX : parser->number * 10;
+                }
+                parser->exponent--;
+            }
+            if (parser->flags & FLAG_NEGATIVE)
+            {
+                parser->number = 0;
+            }
+
+            iperf_params_store(parser, TYPE_U64, parser->number != 0);
+            parser->state = STATE_AFTER;
+            continue; // The character ends the number, it is read again
+
+        case STATE_LITERAL:
+            if (c >= 'a' && c <= 'z')
+            {
+                if (parser->literal[parser->str_len] != c)
+                {
+                    parser->state = STATE_ERROR;
+                }
+                else
+                {
+                    parser->str_len++;
+                }
+                break;
+            }
+
+            if (parser->literal[parser->str_len] != '\0')
+            {
+                parser->state = STATE_ERROR;
+                break;
+            }
+
+            if (parser->literal[0] != 'n')
+            {
+                iperf_params_store(parser, TYPE_BOOL, parser->literal[0] == 't');
+            }
+            parser->state = STATE_AFTER;
+            continue;
+
+        case STATE_SKIP:
+            if (parser->flags & FLAG_SKIP_STRING)
+            {
+                while (c != '"' && c != '\\' && !(parser->flags & FLAG_ESCAPE))
+                {
+                    if (++p == end)
+                    {
+                        return;
+                    }
+                    c = *p;
+                }
+
+                if (parser->flags & FLAG_ESCAPE)
+                {
+                    parser->flags &= ~FLAG_ESCAPE;
+                }
+                else if (c == '\\')
+                {
+                    parser->flags |= FLAG_ESCAPE;
+                }
+                else if (c == '"')
+                {
+                    parser->flags &= ~FLAG_SKIP_STRING;
+                }
+            }
+            else if (c == '"')
+            {
+                parser->flags |= FLAG_SKIP_STRING;
+            }
+            else if (c == '{' || c == '[')
+            {
+                parser->depth++;
+            }
+            else if (c == '}' || c == ']')
+            {
+                if (--parser->depth == 0)
+                {
+                    parser->state = STATE_AFTER;
+                }
+            }
+            break;
+
+        case STATE_AFTER:
+            if (c == ',')
+            {
+                parser->state = STATE_KEY_OR_END;
+            }
+            else if (c == '}')
+            {
+                parser->state = STATE_DONE;
+            }
+            else if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            {
+                parser->state = STATE_ERROR;
+            }
+            break;
+
+        case STATE_DONE:
+            if (c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '\0')
+            {
+                parser->state = STATE_ERROR;
+            }
+            break;
+
+        default:
+            return;
+        }
+
+        p++;
+    }
+}
+
+bool iperf_params_finish(iperf_params_parser_t *parser)
+{
+    return parser->state == STATE_DONE;
+}
+
+bool iperf_params_parse(const char *json, uint32_t len, iperf_params_t *params)
+{
+    iperf_params_parser_t parser;
+
+    iperf_params_init(&parser, params);
+    iperf_params_feed(&parser, json, len);
+
+    return iperf_params_finish(&parser);
+}
+
+static int8_t iperf_params_lookup(const char *key, uint8_t len)
+{
+    for (uint8_t i = 0; i < sizeof(g_params) / sizeof(g_params[0]); i++)
+    {
+        if (g_params[i].key[0] == key[0] && strncmp(g_params[i].key, key, len) == 0 && g_params[i].key[len] == '\0')
+        {
+            return (int8_t)i;
+        }
+    }
+
+    return -1;
+}
+
+/* Store a number or a literal in the parameter of the current key, if the types agree */
+static void iperf_params_store(iperf_params_parser_t *parser, uint8_t type, bool value)
+{
+    const iperf_param_t *param = NULL;
+    uint8_t *field = NULL;
+
+    if (parser->param < 0)
+    {
+        return;
+    }
+
+    param = &g_params[parser->param];
+    field = (uint8_t *)parser->params + param->offset;
+
+    switch (param->type)
+    {
+    case TYPE_BOOL:
+        // iperf3 sends udp_counters_64bit as a number
+        *(bool *)field = value;
+        break;
+
+    case TYPE_U32:
+        if (type != TYPE_U64)
+        {
+            return;
+        }
+        *(uint32_t *)field = (parser->number > UINT32_MAX) ? UINT32_MAX : (uint32_t)parser->number;
+        break;
+
+    case TYPE_U64:
+        if (type != TYPE_U64)
+        {
+            return;
+        }
+        *(uint64_t *)field = parser->number;
+        break;
+
+    default:
+        return;
+    }
+
+    parser->params->present |= 1UL << parser->param;
+}
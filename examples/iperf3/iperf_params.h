@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _IPERF_PARAMS_H_
+#define _IPERF_PARAMS_H_
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Largest parameter message, MAX_PARAMS_JSON_STRING of iperf3 */
+#define IPERF_PARAMS_MAX_SIZE (1024 * 8)
+
+/* Longest key kept by the parser, longer keys are never known ones */
+#define IPERF_PARAMS_KEY_SIZE 24
+
+/* Parameters, bit positions of iperf_params_t.present */
+#define IPERF_PARAM_TCP 0
+#define IPERF_PARAM_UDP 1
+#define IPERF_PARAM_REVERSE 2
+#define IPERF_PARAM_BIDIRECTIONAL 3
+#define IPERF_PARAM_NODELAY 4
+#define IPERF_PARAM_GET_SERVER_OUTPUT 5
+#define IPERF_PARAM_UDP_COUNTERS_64BIT 6
+#define IPERF_PARAM_REPEATING_PAYLOAD 7
+#define IPERF_PARAM_ZEROCOPY 8
+#define IPERF_PARAM_OMIT 9
+#define IPERF_PARAM_TIME 10
+#define IPERF_PARAM_NUM 11
+#define IPERF_PARAM_BLOCKCOUNT 12
+#define IPERF_PARAM_PARALLEL 13
+#define IPERF_PARAM_LEN 14
+#define IPERF_PARAM_BANDWIDTH 15
+#define IPERF_PARAM_FQRATE 16
+#define IPERF_PARAM_PACING_TIMER 17
+#define IPERF_PARAM_BURST 18
+#define IPERF_PARAM_WINDOW 19
+#define IPERF_PARAM_MSS 20
+#define IPERF_PARAM_TOS 21
+#define IPERF_PARAM_CLIENT_VERSION 22
+
+/* The parameter was in the message */
+#define IPERF_PARAMS_HAS(params, param) (((params)->present >> (param)) & 1)
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Parameters of a test, as sent by the iperf3 client. Parameters not in the message are 0 */
+typedef struct
+{
+    uint32_t present;        // IPERF_PARAM_... bits of the parameters in the message
+    bool tcp;
+    bool udp;
+    bool reverse;
+    bool bidirectional;
+    bool nodelay;
+    bool get_server_output;
+    bool udp_counters_64bit;
+    bool repeating_payload;
+    bool zerocopy;
+    uint32_t omit;           // Seconds
+    uint32_t time;           // Seconds
+    uint64_t num;            // Bytes to send, -n
+    uint64_t blockcount;     // Blocks to send, -k
+    uint32_t parallel;
+    uint32_t len;            // Block size
+    uint64_t bandwidth;      // Bits/sec
+    uint64_t fqrate;         // Bits/sec
+    uint32_t pacing_timer;   // Microseconds
+    uint32_t burst;
+    uint32_t window;         // Socket buffer size
+    uint32_t mss;
+    uint32_t tos;
+    char client_version[16]; // Truncated if longer
+} iperf_params_t;
+
+/* Parser, the message may be given in any number of pieces */
+typedef struct
+{
+    iperf_params_t *params;
+    uint8_t state;
+    uint8_t flags;
+    uint8_t depth;           // Nesting of a skipped object or array
+    int8_t param;            // Parameter of the current key, -1 if unknown
+    uint8_t key_len;
+    uint8_t str_len;
+    uint8_t fraction;        // Digits of the number after the point
+    uint16_t exponent;
+    const char *literal;     // true, false or null being read
+    uint64_t number;
+    char key[IPERF_PARAMS_KEY_SIZE];
+} iperf_params_parser_t;
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/*! \brief Initialize parameter parser
+ *  \ingroup iperf_params
+ *
+ *  Clear params and start a parameter message.
+ *
+ *  \param parser parser
+ *  \param params parameters to fill
+ */
+void iperf_params_init(iperf_params_parser_t *parser, iperf_params_t *params);
+
+/*! \brief Parse a piece of the parameter message
+ *  \ingroup iperf_params
+ *
+ *  Scan the bytes once, as they arrive, and store the known parameters in params.
+ *  Unknown keys and their values, nested ones included, are skipped. Nothing is copied
+ *  or allocated, the parser keeps only the key being read.
+ *
+ *  \param parser parser
+ *  \param data piece of the message
+ *  \param len length of the piece
+ */
+void iperf_params_feed(iperf_params_parser_t *parser, const void *data, uint32_t len);
+
+/*! \brief Finish the parameter message
+ *  \ingroup iperf_params
+ *
+ *  \param parser parser
+ *  \return true if the message was a complete JSON object
+ */
+bool iperf_params_finish(iperf_params_parser_t *parser);
+
+/*! \brief Parse a parameter message
+ *  \ingroup iperf_params
+ *
+ *  Parse a whole message held in memory.
+ *
+ *  \param json message
+ *  \param len length of the message
+ *  \param params parameters to fill
+ *  \return true if the message was a complete JSON object
+ */
+bool iperf_params_parse(const char *json, uint32_t len, iperf_params_t *params);
+
+#endif /* _IPERF_PARAMS_H_ */
@@ -0,0 +1,1063 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "iperf.h"
+#include "iperf_json.h"
+#include "iperf_params.h"
+#include "iperf_lwip.h"
+
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+
+#if NETIF_FLOW_CACHE
+#include "w5x00_lwip.h"
+#endif
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Buffer */
+#define ETHERNET_BUF_MAX_SIZE (1024 * 8)
+#define CTRL_BUF_MAX_SIZE 1024
+
+/* Cookie size */
+#define COOKIE_SIZE 37
+
+/* iperf3 Commands */
+#define PARAM_EXCHANGE 9
+#define CREATE_STREAMS 10
+#define TEST_START 1
+#define TEST_RUNNING 2
+#define TEST_END 4
+#define EXCHANGE_RESULTS 13
+#define DISPLAY_RESULTS 14
+#define IPERF_DONE 16
+#define ACCESS_DENIED (-2)
+#define CLIENT_TERMINATE (-1)
+
+/* UDP */
+#define UDP_CONNECT_MSG 0x36373839
+#define UDP_CONNECT_REPLY 0x39383736
+#define UDP_LEGACY_CONNECT_MSG 123456789
+#define UDP_LEGACY_CONNECT_REPLY 987654321
+#define UDP_HEADER_SIZE 12
+#define UDP_HEADER_SIZE_64BIT 16
+#define UDP_PAYLOAD_MAX_SIZE (1500 - 20 - 8) // Largest datagram sent without IP fragmentation
+#define UDP_DEFAULT_BANDWIDTH (1024 * 1024)  // iperf3 default for UDP, in bits/sec
+
+/* Control channel receive states */
+#define CTRL_RX_COOKIE 0
+#define CTRL_RX_PARAM_LEN 1
+#define CTRL_RX_PARAM 2
+#define CTRL_RX_CMD 3
+#define CTRL_RX_RESULTS_LEN 4
+#define CTRL_RX_RESULTS 5
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+typedef struct
+{
+    struct tcp_pcb *pcb;
+    uint8_t id;
+    uint8_t cookie_len;
+    uint8_t cookie[COOKIE_SIZE];
+    uint32_t bytes;
+    uint32_t packets;
+
+    /* UDP */
+    ip_addr_t addr;
+    uint16_t port;
+    struct pbuf *tx_p;    // Datagram reused for every send in reverse tests
+    uint32_t errors;      // Lost datagrams
+    Jitter jitter;
+} iperf_stream_t;
+
+/* iperf */
+static uint8_t g_iperf_buf[ETHERNET_BUF_MAX_SIZE * 2] = {
+    0,
+};
+static Stats g_stats;
+static int8_t g_state = 0;
+
+/* Parameters */
+static bool g_reverse = false;
+static bool g_udp = false;
+static bool g_udp_64bit = false;
+static uint8_t g_parallel = 1;
+static uint16_t g_blksize = UDP_PAYLOAD_MAX_SIZE;
+static uint32_t g_bandwidth = 0;
+static iperf_params_parser_t g_params_parser;
+static iperf_params_t g_params;
+
+/* Control */
+static uint16_t g_port = 0;
+static struct tcp_pcb *g_listen_pcb = NULL;
+static struct tcp_pcb *g_ctrl_pcb = NULL;
+static uint8_t g_cookie[COOKIE_SIZE] = {0};
+static uint8_t g_ctrl_buf[CTRL_BUF_MAX_SIZE];
+static uint8_t g_ctrl_rx_state = CTRL_RX_COOKIE;
+static uint32_t g_ctrl_rx_need = 0;
+static uint32_t g_ctrl_rx_len = 0;
+
+/* Streams */
+static iperf_stream_t g_streams[IPERF_MAX_STREAMS];
+static uint8_t g_num_streams = 0;
+static uint8_t g_ready_streams = 0;
+
+/* UDP */
+static struct udp_pcb *g_udp_pcb = NULL;
+static uint32_t g_udp_start_us = 0;
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Control */
+static err_t iperf_ctrl_accept(void *arg, struct tcp_pcb *newpcb, err_t err);
+static err_t iperf_ctrl_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
+static void iperf_ctrl_err(void *arg, err_t err);
+static void iperf_ctrl_expect(uint8_t rx_state, uint32_t len);
+static err_t iperf_ctrl_handle(void);
+static void iperf_ctrl_send(const void *data, uint16_t len);
+static void iperf_ctrl_send_state(int8_t state);
+static void iperf_ctrl_parse(struct pbuf *p, uint32_t offset, uint32_t len);
+static void iperf_handle_params(void);
+static void iperf_send_results(void);
+static void iperf_results_write(void *arg, const void *data, uint32_t len);
+static err_t iperf_reset(void);
+
+/* Streams */
+static void iperf_stream_accept(struct tcp_pcb *newpcb);
+static err_t iperf_stream_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
+static err_t iperf_stream_sent(void *arg, struct tcp_pcb *tpcb, u16_t len);
+static void iperf_stream_err(void *arg, err_t err);
+static void iperf_stream_write(iperf_stream_t *stream);
+static err_t iperf_stream_close(iperf_stream_t *stream);
+static void iperf_start_test(void);
+static void iperf_stop_test(void);
+
+/* UDP */
+static bool iperf_udp_open(void);
+static void iperf_udp_close(void);
+static void iperf_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
+static void iperf_udp_connect(const ip_addr_t *addr, u16_t port, struct pbuf *p);
+static void iperf_udp_account(iperf_stream_t *stream, struct pbuf *p);
+static void iperf_udp_send(iperf_stream_t *stream);
+
+int8_t iperf_lwip_initialize(uint16_t port)
+{
+    struct tcp_pcb *pcb = NULL;
+
+    pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
+    if (pcb == NULL)
+    {
+        return -1;
+    }
+
+    if (tcp_bind(pcb, IP_ADDR_ANY, port) != ERR_OK)
+    {
+        tcp_close(pcb);
+        return -1;
+    }
+
+    g_listen_pcb = tcp_listen(pcb);
+    if (g_listen_pcb == NULL)
+    {
+        tcp_close(pcb);
+        return -1;
+    }
+
+    tcp_accept(g_listen_pcb, iperf_ctrl_accept);
+    g_port = port;
+
+    iperf_stats_init(&g_stats, 1000);
+
+    printf("[iperf] lwIP iperf3 server listening on port %d\n", port);
+
+    return 0;
+}
+
+void iperf_lwip_process(void)
+{
+    uint32_t elapsed_us = 0;
+    uint64_t allowed = 0;
+
+    if (g_stats.running && g_udp && g_reverse)
+    {
+        elapsed_us = time_us_32() - g_udp_start_us;
+
+        // One datagram per stream and call, so received frames are not starved
+        for (uint8_t i = 0; i < g_num_streams; i++)
+        {
+            if (g_bandwidth != 0)
+            {
+                allowed = (uint64_t)g_bandwidth * elapsed_us / 8000000;
+                if (g_streams[i].bytes >= allowed)
+                {
+                    continue;
+                }
+            }
+            iperf_udp_send(&g_streams[i]);
+        }
+    }
+
+    iperf_stats_update(&g_stats, false);
+}
+
+bool iperf_lwip_idle(void)
+{
+    return g_ctrl_pcb == NULL;
+}
+
+/* Control */
+static err_t iperf_ctrl_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
+{
+    int8_t state = ACCESS_DENIED;
+
+    if (err != ERR_OK || newpcb == NULL)
+    {
+        return ERR_VAL;
+    }
+
+    if (g_ctrl_pcb == NULL)
+    {
+        // First connection is the control channel
+        g_ctrl_pcb = newpcb;
+        g_state = 0;
+
+        tcp_arg(newpcb, NULL);
+        tcp_recv(newpcb, iperf_ctrl_recv);
+        tcp_err(newpcb, iperf_ctrl_err);
+        tcp_nagle_disable(newpcb);
+
+        iperf_ctrl_expect(CTRL_RX_COOKIE, COOKIE_SIZE);
+
+        return ERR_OK;
+    }
+
+    if (g_state == CREATE_STREAMS && !g_udp && g_num_streams < g_parallel)
+    {
+        iperf_stream_accept(newpcb);
+
+        return ERR_OK;
+    }
+
+    // A test is already running
+    tcp_write(newpcb, &state, 1, TCP_WRITE_FLAG_COPY);
+    tcp_output(newpcb);
+    if (tcp_close(newpcb) != ERR_OK)
+    {
+        tcp_abort(newpcb);
+        return ERR_ABRT;
+    }
+
+    return ERR_OK;
+}
+
+static err_t iperf_ctrl_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+{
+    uint16_t offset = 0;
+    uint32_t len = 0;
+    uint32_t copy_len = 0;
+    err_t ret = ERR_OK;
+
+    if (p == NULL)
+    {
+        // Closed by the client
+        return iperf_reset();
+    }
+
+    while (offset < p->tot_len && g_ctrl_pcb == tpcb)
+    {
+        len = g_ctrl_rx_need - g_ctrl_rx_len;
+        if (len > (uint32_t)(p->tot_len - offset))
+        {
+            len = p->tot_len - offset;
+        }
+
+        // Parameters are parsed straight from the pbufs, anything else beyond the buffer is consumed but not stored
+        if (g_ctrl_rx_state == CTRL_RX_PARAM)
+        {
+            iperf_ctrl_parse(p, offset, len);
+        }
+        else if (g_ctrl_rx_len < sizeof(g_ctrl_buf) - 1)
+        {
+            copy_len = sizeof(g_ctrl_buf) - 1 - g_ctrl_rx_len;
+            if (copy_len > len)
+            {
+                copy_len = len;
+            }
+            pbuf_copy_partial(p, g_ctrl_buf + g_ctrl_rx_len, copy_len, offset);
+        }
+
+        g_ctrl_rx_len += len;
+        offset += len;
+
+        if (g_ctrl_rx_len == g_ctrl_rx_need)
+        {
+            ret = iperf_ctrl_handle();
+        }
+    }
+
+    if (g_ctrl_pcb == tpcb)
+    {
+        tcp_recved(tpcb, p->tot_len);
+    }
+    pbuf_free(p);
+
+    return ret;
+}
+
+static void iperf_ctrl_err(void *arg, err_t err)
+{
+    // The pcb has already been freed
+    g_ctrl_pcb = NULL;
+
+    printf("[iperf] Control connection error: %d\n", err);
+
+    iperf_reset();
+}
+
+static void iperf_ctrl_expect(uint8_t rx_state, uint32_t len)
+{
+    g_ctrl_rx_state = rx_state;
+    g_ctrl_rx_need = len;
+    g_ctrl_rx_len = 0;
+}
+
+static err_t iperf_ctrl_handle(void)
+{
+    uint32_t len = 0;
+    int8_t cmd = 0;
+
+    switch (g_ctrl_rx_state)
+    {
+    case CTRL_RX_COOKIE:
+        memcpy(g_cookie, g_ctrl_buf, COOKIE_SIZE);
+#ifdef IPERF_DEBUG
+        printf("[iperf] Received cookie: %s\n", g_cookie);
+#endif
+        iperf_ctrl_send_state(PARAM_EXCHANGE);
+        iperf_ctrl_expect(CTRL_RX_PARAM_LEN, 4);
+        break;
+
+    case CTRL_RX_PARAM_LEN:
+        len = ((uint32_t)g_ctrl_buf[0] << 24) | ((uint32_t)g_ctrl_buf[1] << 16) | ((uint32_t)g_ctrl_buf[2] << 8) | g_ctrl_buf[3];
+        if (len == 0 || len > IPERF_PARAMS_MAX_SIZE)
+        {
+            printf("[iperf] Parameter length %u exceeds the iperf3 maximum.\n", len);
+            return iperf_reset();
+        }
+        iperf_params_init(&g_params_parser, &g_params);
+#ifdef IPERF_DEBUG
+        printf("[iperf] Received parameters: ");
+#endif
+        iperf_ctrl_expect(CTRL_RX_PARAM, len);
+        break;
+
+    case CTRL_RX_PARAM:
+#ifdef IPERF_DEBUG
+        printf("\n");
+#endif
+        iperf_handle_params();
+
+        g_num_streams = 0;
+        g_ready_streams = 0;
+        if (g_udp && !iperf_udp_open())
+        {
+            printf("[iperf] Failed to open UDP data socket\n");
+            return iperf_reset();
+        }
+        iperf_ctrl_send_state(CREATE_STREAMS);
+        iperf_ctrl_expect(CTRL_RX_CMD, 1);
+        break;
+
+    case CTRL_RX_CMD:
+        cmd = (int8_t)g_ctrl_buf[0];
+        if (cmd == TEST_END)
+        {
+            iperf_stop_test();
+            iperf_ctrl_send_state(EXCHANGE_RESULTS);
+            iperf_ctrl_expect(CTRL_RX_RESULTS_LEN, 4);
+        }
+        else if (cmd == IPERF_DONE)
+        {
+            printf("[iperf] Test completed successfully.\n");
+            return iperf_reset();
+        }
+        else if (cmd == CLIENT_TERMINATE)
+        {
+            printf("[iperf] Client terminated the test.\n");
+            return iperf_reset();
+        }
+        else
+        {
+            printf("[iperf] Unexpected command received: %d\n", cmd);
+            iperf_ctrl_expect(CTRL_RX_CMD, 1);
+        }
+        break;
+
+    case CTRL_RX_RESULTS_LEN:
+        len = ((uint32_t)g_ctrl_buf[0] << 24) | ((uint32_t)g_ctrl_buf[1] << 16) | ((uint32_t)g_ctrl_buf[2] << 8) | g_ctrl_buf[3];
+        iperf_ctrl_expect(CTRL_RX_RESULTS, len);
+        if (len == 0)
+        {
+            return iperf_ctrl_handle();
+        }
+        break;
+
+    case CTRL_RX_RESULTS:
+#ifdef IPERF_DEBUG
+        g_ctrl_buf[g_ctrl_rx_len < sizeof(g_ctrl_buf) ? g_ctrl_rx_len : sizeof(g_ctrl_buf) - 1] = '\0';
+        printf("[iperf] Client results received: %s\n", g_ctrl_buf);
+#endif
+        iperf_send_results();
+        iperf_ctrl_send_state(DISPLAY_RESULTS);
+        iperf_ctrl_expect(CTRL_RX_CMD, 1);
+        break;
+
+    default:
+        break;
+    }
+
+    return ERR_OK;
+}
+
+static void iperf_ctrl_send(const void *data, uint16_t len)
+{
+    if (g_ctrl_pcb == NULL)
+    {
+        return;
+    }
+
+    if (tcp_write(g_ctrl_pcb, data, len, TCP_WRITE_FLAG_COPY) != ERR_OK)
+    {
+        printf("[iperf] Failed to send on control connection\n");
+        return;
+    }
+    tcp_output(g_ctrl_pcb);
+}
+
+static void iperf_ctrl_send_state(int8_t state)
+{
+    g_state = state;
+
+    iperf_ctrl_send(&state, 1);
+}
+
+static void iperf_ctrl_parse(struct pbuf *p, uint32_t offset, uint32_t len)
+{
+    uint32_t part = 0;
+
+    for (; p != NULL && len > 0; p = p->next)
+    {
+        if (offset >= p->len)
+        {
+            offset -= p->len;
+            continue;
+        }
+
+        part = p->len - offset;
+        if (part > len)
+        {
+            part = len;
+        }
+
+#ifdef IPERF_DEBUG
+        printf("%.*s", (int)part, (char *)p->payload + offset);
+#endif
+        iperf_params_feed(&g_params_parser, (uint8_t *)p->payload + offset, part);
+
+        len -= part;
+        offset = 0;
+    }
+}
+
+static void iperf_handle_params(void)
+{
+    g_reverse = false;
+    g_udp = false;
+    g_udp_64bit = false;
+    g_parallel = 1;
+    g_blksize = UDP_PAYLOAD_MAX_SIZE;
+    g_bandwidth = 0;
+
+    if (!iperf_params_finish(&g_params_parser))
+    {
+        printf("[iperf] Failed to parse JSON parameters\n");
+        return;
+    }
+
+    g_reverse = g_params.reverse;
+    g_udp = g_params.udp;
+    g_udp_64bit = g_params.udp_counters_64bit;
+
+    if (g_params.parallel > 0)
+    {
+        g_parallel = g_params.parallel > IPERF_MAX_STREAMS ? IPERF_MAX_STREAMS : g_params.parallel;
+    }
+
+    if (g_params.len > 0)
+    {
+        g_blksize = g_params.len > UINT16_MAX ? UINT16_MAX : g_params.len;
+    }
+
+    if (IPERF_PARAMS_HAS(&g_params, IPERF_PARAM_BANDWIDTH))
+    {
+        g_bandwidth = g_params.bandwidth > UINT32_MAX ? UINT32_MAX : (uint32_t)g_params.bandwidth;
+    }
+    else
+    {
+        g_bandwidth = g_udp ? UDP_DEFAULT_BANDWIDTH : 0;
+    }
+
+    if (g_udp)
+    {
+        // Datagrams must fit in one pool pbuf and carry the iperf3 header
+        if (g_blksize > UDP_PAYLOAD_MAX_SIZE)
+        {
+            printf("[iperf] UDP length %d limited to %d bytes\n", g_blksize, UDP_PAYLOAD_MAX_SIZE);
+            g_blksize = UDP_PAYLOAD_MAX_SIZE;
+        }
+        if (g_blksize < UDP_HEADER_SIZE_64BIT)
+        {
+            g_blksize = UDP_HEADER_SIZE_64BIT;
+        }
+    }
+
+#ifdef IPERF_DEBUG
+    printf("[iperf] Parsed JSON: reverse=%d, udp=%d, parallel=%d, len=%d, bandwidth=%u\n", g_reverse, g_udp, g_parallel, g_blksize, g_bandwidth);
+#endif
+}
+
+static void iperf_send_results(void)
+{
+    iperf_json_stream_t results[IPERF_MAX_STREAMS];
+
+    for (uint8_t i = 0; i < g_num_streams; i++)
+    {
+        results[i].id = g_streams[i].id;
+        results[i].bytes = g_streams[i].bytes;
+        results[i].retransmits = -1;
+        results[i].jitter_us = g_streams[i].jitter.jitter_x16 / 16;
+        results[i].errors = g_streams[i].errors;
+        results[i].packets = g_streams[i].packets;
+        results[i].start_us = 0;
+        results[i].end_us = g_stats.t3 - g_stats.t0;
+    }
+
+    // Send server results, written in chunks straight to the control connection
+    iperf_json_send_results(results, g_num_streams, 0, iperf_results_write, NULL);
+
+    if (g_ctrl_pcb != NULL)
+    {
+        tcp_output(g_ctrl_pcb);
+    }
+}
+
+/* Results are queued without output, they leave in full segments once all are written */
+static void iperf_results_write(void *arg, const void *data, uint32_t len)
+{
+    (void)arg;
+
+    if (g_ctrl_pcb == NULL)
+    {
+        return;
+    }
+
+    if (tcp_write(g_ctrl_pcb, data, len, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) != ERR_OK)
+    {
+        printf("[iperf] Failed to send on control connection\n");
+    }
+}
+
+static err_t iperf_reset(void)
+{
+    struct tcp_pcb *pcb = g_ctrl_pcb;
+
+    if (g_stats.running)
+    {
+        iperf_stop_test();
+    }
+
+    for (uint8_t i = 0; i < g_num_streams; i++)
+    {
+        iperf_stream_close(&g_streams[i]);
+    }
+    g_num_streams = 0;
+    g_ready_streams = 0;
+
+    iperf_udp_close();
+
+#if NETIF_FLOW_CACHE
+    netif_flow_cache_clear();
+#endif
+
+    g_ctrl_pcb = NULL;
+    g_state = 0;
+
+    if (pcb != NULL)
+    {
+        tcp_arg(pcb, NULL);
+        tcp_recv(pcb, NULL);
+        tcp_err(pcb, NULL);
+
+        if (tcp_close(pcb) != ERR_OK)
+        {
+            tcp_abort(pcb);
+            return ERR_ABRT;
+        }
+    }
+
+    return ERR_OK;
+}
+
+/* Streams */
+static void iperf_stream_accept(struct tcp_pcb *newpcb)
+{
+    iperf_stream_t *stream = &g_streams[g_num_streams];
+
+    memset(stream, 0, sizeof(iperf_stream_t));
+    stream->pcb = newpcb;
+
+    // iperf3 numbers streams 1, 3, 4, ...
+    stream->id = (g_num_streams == 0) ? 1 : g_num_streams + 2;
+    g_num_streams++;
+
+    tcp_arg(newpcb, stream);
+    tcp_recv(newpcb, iperf_stream_recv);
+    tcp_sent(newpcb, iperf_stream_sent);
+    tcp_err(newpcb, iperf_stream_err);
+
+#if NETIF_FLOW_CACHE
+    netif_flow_cache_add(&newpcb->remote_ip, newpcb->remote_port, newpcb->local_port);
+#endif
+}
+
+static err_t iperf_stream_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+{
+    iperf_stream_t *stream = (iperf_stream_t *)arg;
+    uint16_t len = 0;
+    uint16_t offset = 0;
+
+    if (p == NULL)
+    {
+        // Closed by the client, close our side without entering TIME_WAIT
+        return iperf_stream_close(stream);
+    }
+
+    if (stream->cookie_len < COOKIE_SIZE)
+    {
+        len = pbuf_copy_partial(p, stream->cookie + stream->cookie_len, COOKIE_SIZE - stream->cookie_len, 0);
+        stream->cookie_len += len;
+        offset = len;
+
+        if (stream->cookie_len == COOKIE_SIZE)
+        {
+#ifdef IPERF_DEBUG
+            printf("[iperf] Received data cookie: %s\n", stream->cookie);
+#endif
+            if (memcmp(stream->cookie, g_cookie, COOKIE_SIZE) != 0)
+            {
+                printf("[iperf] Data stream cookie mismatch\n");
+                pbuf_free(p);
+                tcp_abort(tpcb);
+                stream->pcb = NULL;
+                return ERR_ABRT;
+            }
+
+            if (++g_ready_streams == g_parallel)
+            {
+                iperf_start_test();
+            }
+        }
+    }
+
+    // Count goodput only, headers and ACKs are not part of the payload
+    if (g_stats.running && p->tot_len > offset)
+    {
+        stream->bytes += p->tot_len - offset;
+        stream->packets++;
+        iperf_stats_add_bytes(&g_stats, p->tot_len - offset);
+    }
+
+    tcp_recved(tpcb, p->tot_len);
+    pbuf_free(p);
+
+    return ERR_OK;
+}
+
+static err_t iperf_stream_sent(void *arg, struct tcp_pcb *tpcb, u16_t len)
+{
+    iperf_stream_t *stream = (iperf_stream_t *)arg;
+
+    if (g_stats.running)
+    {
+        stream->bytes += len;
+        stream->packets++;
+        iperf_stats_add_bytes(&g_stats, len);
+
+        iperf_stream_write(stream);
+    }
+
+    return ERR_OK;
+}
+
+static void iperf_stream_err(void *arg, err_t err)
+{
+    iperf_stream_t *stream = (iperf_stream_t *)arg;
+
+    // The pcb has already been freed
+    stream->pcb = NULL;
+
+    printf("[iperf] Data stream %d error: %d\n", stream->id, err);
+}
+
+static void iperf_stream_write(iperf_stream_t *stream)
+{
+    uint16_t len = 0;
+
+    while (stream->pcb != NULL)
+    {
+        len = tcp_sndbuf(stream->pcb);
+        if (len > ETHERNET_BUF_MAX_SIZE / 2)
+        {
+            len = ETHERNET_BUF_MAX_SIZE / 2;
+        }
+
+        // Wait for ACKs rather than queueing runt segments
+        if (len < TCP_MSS)
+        {
+            break;
+        }
+
+        // The payload is static, so the segments reference it instead of copying it
+        if (tcp_write(stream->pcb, g_iperf_buf, len, 0) != ERR_OK)
+        {
+            break;
+        }
+    }
+
+    if (stream->pcb != NULL)
+    {
+        tcp_output(stream->pcb);
+    }
+}
+
+static err_t iperf_stream_close(iperf_stream_t *stream)
+{
+    struct tcp_pcb *pcb = stream->pcb;
+
+    if (pcb == NULL)
+    {
+        return ERR_OK;
+    }
+    stream->pcb = NULL;
+
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+
+    if (tcp_close(pcb) != ERR_OK)
+    {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    return ERR_OK;
+}
+
+static void iperf_start_test(void)
+{
+    iperf_ctrl_send_state(TEST_START);
+    iperf_ctrl_send_state(TEST_RUNNING);
+
+    iperf_stats_start(&g_stats);
+
+    if (g_udp)
+    {
+        // Datagrams are paced from iperf_lwip_process()
+        g_udp_start_us = time_us_32();
+    }
+    else if (g_reverse)
+    {
+        memset(g_iperf_buf, 0xAA, ETHERNET_BUF_MAX_SIZE / 2);
+
+        // Queue the first segments, tcp_sent() refills the send buffer from now on
+        for (uint8_t i = 0; i < g_num_streams; i++)
+        {
+            iperf_stream_write(&g_streams[i]);
+        }
+    }
+}
+
+static void iperf_stop_test(void)
+{
+    iperf_stats_update(&g_stats, true);
+    iperf_stats_stop(&g_stats);
+
+#if NETIF_FLOW_CACHE
+    netif_flow_cache_stats_print();
+#endif
+}
+
+/* UDP */
+static bool iperf_udp_open(void)
+{
+    iperf_udp_close();
+
+    g_udp_pcb = udp_new_ip_type(IPADDR_TYPE_V4);
+    if (g_udp_pcb == NULL)
+    {
+        return false;
+    }
+
+    if (udp_bind(g_udp_pcb, IP_ADDR_ANY, g_port) != ERR_OK)
+    {
+        udp_remove(g_udp_pcb);
+        g_udp_pcb = NULL;
+        return false;
+    }
+
+    udp_recv(g_udp_pcb, iperf_udp_recv, NULL);
+
+    return true;
+}
+
+static void iperf_udp_close(void)
+{
+    for (uint8_t i = 0; i < IPERF_MAX_STREAMS; i++)
+    {
+        if (g_streams[i].tx_p != NULL)
+        {
+            pbuf_free(g_streams[i].tx_p);
+            g_streams[i].tx_p = NULL;
+        }
+    }
+
+    if (g_udp_pcb != NULL)
+    {
+        udp_remove(g_udp_pcb);
+        g_udp_pcb = NULL;
+    }
+}
+
+static void iperf_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    iperf_stream_t *stream = NULL;
+
+    // Every stream sends from its own port, so the source identifies the stream
+    for (uint8_t i = 0; i < g_num_streams; i++)
+    {
+        if (g_streams[i].port == port && ip_addr_cmp(&g_streams[i].addr, addr))
+        {
+            stream = &g_streams[i];
+            break;
+        }
+    }
+
+    if (stream == NULL)
+    {
+        if (g_state == CREATE_STREAMS && g_num_streams < g_parallel)
+        {
+            iperf_udp_connect(addr, port, p);
+        }
+    }
+    else if (g_stats.running && !g_reverse)
+    {
+        iperf_udp_account(stream, p);
+    }
+
+    pbuf_free(p);
+}
+
+static void iperf_udp_connect(const ip_addr_t *addr, u16_t port, struct pbuf *p)
+{
+    iperf_stream_t *stream = &g_streams[g_num_streams];
+    struct pbuf *reply = NULL;
+    uint8_t msg[4] = {0};
+    uint32_t value = 0;
+
+    if (pbuf_copy_partial(p, msg, sizeof(msg), 0) != sizeof(msg))
+    {
+        return;
+    }
+
+    // The client writes the message in its own byte order, answer in the same order
+    value = ((uint32_t)msg[3] << 24) | ((uint32_t)msg[2] << 16) | ((uint32_t)msg[1] << 8) | msg[0];
+    if (value == UDP_CONNECT_MSG || value == UDP_LEGACY_CONNECT_MSG)
+    {
+        value = (value == UDP_CONNECT_MSG) ? UDP_CONNECT_REPLY : UDP_LEGACY_CONNECT_REPLY;
+        msg[0] = value & 0xFF;
+        msg[1] = (value >> 8) & 0xFF;
+        msg[2] = (value >> 16) & 0xFF;
+        msg[3] = (value >> 24) & 0xFF;
+    }
+    else
+    {
+        value = ((uint32_t)msg[0] << 24) | ((uint32_t)msg[1] << 16) | ((uint32_t)msg[2] << 8) | msg[3];
+        value = (value == UDP_LEGACY_CONNECT_MSG) ? UDP_LEGACY_CONNECT_REPLY : UDP_CONNECT_REPLY;
+        msg[0] = (value >> 24) & 0xFF;
+        msg[1] = (value >> 16) & 0xFF;
+        msg[2] = (value >> 8) & 0xFF;
+        msg[3] = value & 0xFF;
+    }
+
+    reply = pbuf_alloc(PBUF_TRANSPORT, sizeof(msg), PBUF_RAM);
+    if (reply == NULL)
+    {
+        return;
+    }
+    pbuf_take(reply, msg, sizeof(msg));
+    udp_sendto(g_udp_pcb, reply, addr, port);
+    pbuf_free(reply);
+
+    memset(stream, 0, sizeof(iperf_stream_t));
+    ip_addr_copy(stream->addr, *addr);
+    stream->port = port;
+
+    // iperf3 numbers streams 1, 3, 4, ...
+    stream->id = (g_num_streams == 0) ? 1 : g_num_streams + 2;
+    g_num_streams++;
+
+#ifdef IPERF_DEBUG
+    printf("[iperf] Received UDP handshake from %s:%d\n", ipaddr_ntoa(addr), port);
+#endif
+
+    if (g_reverse)
+    {
+        // One pool pbuf per stream is allocated here and reused for the whole test
+        stream->tx_p = pbuf_alloc(PBUF_TRANSPORT, g_blksize, PBUF_POOL);
+        if (stream->tx_p == NULL || stream->tx_p->next != NULL)
+        {
+            printf("[iperf] Failed to allocate UDP datagram\n");
+        }
+        else
+        {
+            memset(stream->tx_p->payload, 0xAA, g_blksize);
+        }
+    }
+
+    if (++g_ready_streams == g_parallel)
+    {
+        iperf_start_test();
+    }
+}
+
+static void iperf_udp_account(iperf_stream_t *stream, struct pbuf *p)
+{
+    uint8_t hdr[UDP_HEADER_SIZE_64BIT];
+    uint32_t sec = 0;
+    uint32_t usec = 0;
+    uint32_t pcount = 0;
+    uint16_t hdr_len = g_udp_64bit ? UDP_HEADER_SIZE_64BIT : UDP_HEADER_SIZE;
+
+    if (pbuf_copy_partial(p, hdr, hdr_len, 0) != hdr_len)
+    {
+        return;
+    }
+
+    sec = ((uint32_t)hdr[0] << 24) | ((uint32_t)hdr[1] << 16) | ((uint32_t)hdr[2] << 8) | hdr[3];
+    usec = ((uint32_t)hdr[4] << 24) | ((uint32_t)hdr[5] << 16) | ((uint32_t)hdr[6] << 8) | hdr[7];
+
+    // With 64-bit counters only the low word is kept, it does not wrap within a test
+    pcount = ((uint32_t)hdr[hdr_len - 4] << 24) | ((uint32_t)hdr[hdr_len - 3] << 16) | ((uint32_t)hdr[hdr_len - 2] << 8) | hdr[hdr_len - 1];
+
+    // Loss and reordering, counted like the iperf3 receiver does
+    if (pcount >= stream->packets + 1)
+    {
+        if (pcount > stream->packets + 1)
+        {
+            stream->errors += (pcount - 1) - stream->packets;
+        }
+        stream->packets = pcount;
+    }
+    else if (stream->errors > 0)
+    {
+        stream->errors--;
+    }
+
+    iperf_jitter_update(&stream->jitter, time_us_32(), sec, usec);
+
+    stream->bytes += p->tot_len;
+    iperf_stats_add_bytes(&g_stats, p->tot_len);
+}
+
+static void iperf_udp_send(iperf_stream_t *stream)
+{
+    struct pbuf *p = stream->tx_p;
+    uint8_t *payload = NULL;
+    uint64_t now_us = 0;
+    uint32_t sec = 0;
+    uint32_t usec = 0;
+    uint32_t pcount = 0;
+    uint16_t hdr_len = g_udp_64bit ? UDP_HEADER_SIZE_64BIT : UDP_HEADER_SIZE;
+
+    if (p == NULL)
+    {
+        return;
+    }
+    payload = (uint8_t *)p->payload;
+
+    now_us = time_us_64();
+    sec = (uint32_t)(now_us / 1000000);
+    usec = (uint32_t)(now_us % 1000000);
+    pcount = stream->packets + 1;
+
+    payload[0] = (sec >> 24) & 0xFF;
+    payload[1] = (sec >> 16) & 0xFF;
+    payload[2] = (sec >> 8) & 0xFF;
+    payload[3] = sec & 0xFF;
+    payload[4] = (usec >> 24) & 0xFF;
+    payload[5] = (usec >> 16) & 0xFF;
+    payload[6] = (usec >> 8) & 0xFF;
+    payload[7] = usec & 0xFF;
+    memset(payload + 8, 0, hdr_len - 8);
+    payload[hdr_len - 4] = (pcount >> 24) & 0xFF;
+    payload[hdr_len - 3] = (pcount >> 16) & 0xFF;
+    payload[hdr_len - 2] = (pcount >> 8) & 0xFF;
+    payload[hdr_len - 1] = pcount & 0xFF;
+
+    if (udp_sendto(g_udp_pcb, p, &stream->addr, stream->port) == ERR_OK)
+    {
+        stream->packets = pcount;
+        stream->bytes += g_blksize;
+        iperf_stats_add_bytes(&g_stats, g_blksize);
+    }
+
+    if (p->ref != 1)
+    {
+        // Still referenced, e.g. queued for ARP resolution, so it can not be reused
+        pbuf_free(p);
+        stream->tx_p = pbuf_alloc(PBUF_TRANSPORT, g_blksize, PBUF_POOL);
+        if (stream->tx_p != NULL)
+        {
+            memset(stream->tx_p->payload, 0xAA, g_blksize);
+        }
+    }
+    else if (p->payload != payload)
+    {
+        // The stack prepends its headers in place, move the payload back for the next send
+        pbuf_remove_header(p, (uint8_t *)payload - (uint8_t *)p->payload);
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _IPERF_LWIP_H_
+#define _IPERF_LWIP_H_
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Streams */
+#define IPERF_MAX_STREAMS 4
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/*! \brief Initialize iperf3 server
+ *  \ingroup iperf_lwip
+ *
+ *  Open the iperf3 server on the lwIP raw TCP API.
+ *  The control connection and the data streams are both accepted on this port.
+ *
+ *  \param port iperf3 server port
+ *  \return 0 if the server is listening, -1 otherwise
+ */
+int8_t iperf_lwip_initialize(uint16_t port);
+
+/*! \brief Run iperf3 server
+ *  \ingroup iperf_lwip
+ *
+ *  Update the interval statistics of a running test.
+ *  It must be called periodically from the main loop together with sys_check_timeouts().
+ *
+ *  \param none
+ */
+void iperf_lwip_process(void);
+
+/*! \brief iperf3 server state
+ *  \ingroup iperf_lwip
+ *
+ *  \param none
+ *  \return true if no client is connected
+ */
+bool iperf_lwip_idle(void);
+
+#endif /* _IPERF_LWIP_H_ */
@@ -20,16 +20,17 @@
 
 #include "socket.h"
 
-#include "cJSON.h" // JSON handling library
-#include "iperf.h"
+#include "iperf_lwip.h"
 
 #include "lwip/init.h"
 #include "lwip/netif.h"
 #include "lwip/timeouts.h"
-
-#include "lwip/apps/lwiperf.h"
 #include "lwip/etharp.h"
 
+#if LWIP_DUAL_CORE
+#include "pico/multicore.h"
+#endif
+
 /**
  * ----------------------------------------------------------------------------------------------------
  * Macros
@@ -39,30 +40,21 @@
 // #define PLL_SYS_KHZ (133 * 1000)
 #define PLL_SYS_KHZ (90 * 1000)
 
-/* Buffer */
-#define ETHERNET_BUF_MAX_SIZE (1024 * 8)
-
 /* Socket */
-#define SOCKET_DATA 0
-#define SOCKET_CTRL 1
+#define SOCKET_MACRAW 0
 
 /* Port */
 #define PORT_IPERF 5201
 
-#define MAX_RESULT_LEN 1024
+/* Core 1 */
+#define CORE1_STACK_SIZE (1024 * 8)
 
-/* Cookie size */
-#define COOKIE_SIZE 37
-
-/* iperf3 Commands */
-#define PARAM_EXCHANGE 9
-#define CREATE_STREAMS 10
-#define TEST_START 1
-#define TEST_RUNNING 2
-#define TEST_END 4
-#define EXCHANGE_RESULTS 13
-#define DISPLAY_RESULTS 14
-#define IPERF_DONE 16
+/* MACRAW filter change, handshake between core 0 and core 1 */
+#define MACRAW_FILTER_NONE 0      // No change pending
+#define MACRAW_FILTER_REQUESTED 1 // Core 0 asked core 1 to pause
+#define MACRAW_FILTER_PAUSED 2    // Core 1 is idle and waits, core 0 may reopen the socket
+#define MACRAW_FILTER_BUSY 3      // Core 1 is running a test, nothing is changed
+#define MACRAW_FILTER_DONE 4      // Core 0 has reopened the socket, core 1 resumes
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -80,12 +72,6 @@ static wiz_NetInfo g_net_info =
         .dhcp = NETINFO_STATIC                       // DHCP enable/disable
 };
 
-/* iperf */
-static uint8_t g_iperf_buf[ETHERNET_BUF_MAX_SIZE * 2] = {
-    0,
-};
-static uint8_t cookie[COOKIE_SIZE] = {0};
-
 /* Network */
 extern uint8_t mac[6];
 static ip_addr_t g_ip;
@@ -94,7 +80,15 @@ static ip_addr_t g_gateway;
 
 /* LWIP */
 struct netif g_netif;
-lwiperf_report_fn fn;
+
+#if LWIP_DUAL_CORE
+/* Core 1, printf and the results writer need more than the default stack */
+static uint32_t g_core1_stack[CORE1_STACK_SIZE / sizeof(uint32_t)];
+
+/* MACRAW filter change, the test state belongs to core 1 and the socket to core 0 */
+static volatile uint8_t g_filter_state = MACRAW_FILTER_NONE;
+static uint8_t g_filter_flag = 0;
+#endif
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -103,10 +97,19 @@ lwiperf_report_fn fn;
  */
 /* Clock */
 static void set_clock_khz(void);
-void handle_param_exchange(bool *reverse);
-void handle_create_streams(void);
-void start_iperf_test(Stats *stats, bool reverse);
-void exchange_results(Stats *stats);
+
+/* MACRAW filter */
+static void macraw_filter_command(void);
+static void macraw_filter_apply(uint8_t flag);
+#if LWIP_DUAL_CORE
+static void macraw_filter_poll(void);
+static void macraw_filter_pause(void);
+#endif
+
+/* LWIP */
+#if LWIP_DUAL_CORE
+static void core1_entry(void);
+#endif
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -116,9 +119,16 @@ void exchange_results(Stats *stats);
 int main()
 {
     /* Initialize */
-    bool reverse = false;
-    uint8_t socket_status;
-    Stats stats;
+    int8_t retval = 0;
+#if !LWIP_DUAL_CORE
+#if MACRAW_RX_BATCH
+    struct pbuf *frames[MACRAW_RX_BATCH_FRAMES];
+    uint16_t count = 0;
+#else
+    uint16_t pack_len = 0;
+#endif
+    struct pbuf *p = NULL;
+#endif
 
     // Initialize network configuration
     IP4_ADDR(&g_ip, 192, 168, 11, 102);
@@ -137,10 +147,19 @@ int main()
     wizchip_initialize();
     wizchip_check();
 
+#if LWIP_DUAL_CORE
+    // The lock shared by both cores is used from lwip_init() on
+    netif_io_initialize();
+#endif
+
     // Initialize LWIP in NO_SYS mode
     lwip_init();
 
+#if NETIF_FLOW_CACHE
+    netif_add(&g_netif, &g_ip, &g_mask, &g_gateway, NULL, netif_initialize, netif_flow_input);
+#else
     netif_add(&g_netif, &g_ip, &g_mask, &g_gateway, NULL, netif_initialize, netif_input);
+#endif
     g_netif.name[0] = 'e';
     g_netif.name[1] = '0';
 
@@ -152,39 +171,79 @@ int main()
     /* Get network information */
     print_network_information(g_net_info);
 
-    socket(SOCKET_CTRL, Sn_MR_TCP, PORT_IPERF, 0);
+    printf(" lwIP profile : %s (PBUF_POOL %d x %d bytes, MEM_SIZE %d bytes, TCP_WND %d bytes)\n",
+           LWIP_PROFILE_NAME, PBUF_POOL_SIZE, PBUF_POOL_BUFSIZE, MEM_SIZE, (int)TCP_WND);
+    printf(" lwIP core    : %s\n\n", LWIP_DUAL_CORE ? "core 1 (MACRAW I/O on core 0)" : "core 0");
 
-    listen(SOCKET_CTRL);
+    // Every frame goes through lwIP, so the MACRAW socket is opened once at boot
+    retval = netif_macraw_open(SOCKET_MACRAW, MACRAW_FILTER_DEFAULT);
+
+    if (retval < 0)
+    {
+        printf(" MACRAW socket open failed\n");
+    }
+    netif_macraw_stats_print();
+
+    // Keep the test traffic before other frames when the pbuf pool runs low
+    netif_rx_priority_port(PORT_IPERF);
+
+    // Set the default interface and bring it up
+    netif_set_link_up(&g_netif);
+    netif_set_up(&g_netif);
+
+    if (iperf_lwip_initialize(PORT_IPERF) < 0)
+    {
+        printf("[iperf] Failed to open iperf3 server\n");
+    }
+
+#if LWIP_DUAL_CORE
+    // From here on lwIP only runs on core 1 and core 0 only drives the SPI bus
+    multicore_launch_core1_with_stack(core1_entry, g_core1_stack, sizeof(g_core1_stack));
 
     while (1)
     {
-        iperf_stats_init(&stats, 1000);
+        netif_io_process(SOCKET_MACRAW);
 
-        socket_status = getSn_SR(SOCKET_CTRL);
+        macraw_filter_command();
+        macraw_filter_poll();
+    }
+#else
+    while (1)
+    {
+#if MACRAW_RX_BATCH
+        count = recv_lwip_batch(SOCKET_MACRAW, frames, MACRAW_RX_BATCH_FRAMES);
 
-        if (socket_status == SOCK_ESTABLISHED)
+        for (uint16_t i = 0; i < count; i++)
         {
-            handle_param_exchange(&reverse);
-            handle_create_streams();
+            p = frames[i];
 
-            if (reverse)
+            if (g_netif.input(p, &g_netif) != ERR_OK)
             {
-                memset(g_iperf_buf, 0xAA, ETHERNET_BUF_MAX_SIZE / 2);
+                pbuf_free(p);
             }
-            
-            start_iperf_test(&stats, reverse);
-        } 
-        else if (socket_status == SOCK_CLOSE_WAIT)
-        {
-            disconnect(SOCKET_CTRL);
-            disconnect(SOCKET_DATA);
-        } 
-        else if (socket_status == SOCK_CLOSED)
+        }
+#else
+        getsockopt(SOCKET_MACRAW, SO_RECVBUF, &pack_len);
+
+        if (pack_len > 0)
         {
-            socket(SOCKET_CTRL, Sn_MR_TCP, PORT_IPERF, 0);
-            listen(SOCKET_CTRL);
+            p = recv_lwip_pbuf(SOCKET_MACRAW);
+
+            if (p != NULL && g_netif.input(p, &g_netif) != ERR_OK)
+            {
+                pbuf_free(p);
+            }
         }
+#endif
+
+        /* Cyclic lwIP timers check */
+        sys_check_timeouts();
+
+        iperf_lwip_process();
+
+        macraw_filter_command();
     }
+#endif
 }
 
 /**
@@ -208,262 +267,130 @@ static void set_clock_khz(void)
     );
 }
 
-void handle_param_exchange(bool *reverse) 
+/* MACRAW filter */
+static void macraw_filter_command(void)
 {
-    char buffer[512] = {0};
-    uint8_t cmd;
-    uint16_t len = 0;
-    uint8_t raw_len[4] = {0};
-    int cookie_len;
-    cJSON *json;
-    cJSON *reverseItem;
-    cJSON *udpItem;
-
-    cookie_len = recv(SOCKET_CTRL, cookie, COOKIE_SIZE);
-    if (cookie_len != COOKIE_SIZE)
+    int c = getchar_timeout_us(0);
+    uint8_t flag = 0;
+
+    if (c == PICO_ERROR_TIMEOUT)
     {
-        printf("[iperf] Failed to receive cookie. Received: %d bytes\n", cookie_len);
         return;
     }
 
-#ifdef IPERF_DEBUG
-    printf("[iperf] Received cookie: %s\n", cookie);
-#endif
-
-    cmd = PARAM_EXCHANGE;
-    send(SOCKET_CTRL, &cmd, 1);
-    recv(SOCKET_CTRL, raw_len, 4);
-
-    len = (raw_len[0] << 24) | (raw_len[1] << 16) | (raw_len[2] << 8) | raw_len[3];
-#ifdef IPERF_DEBUG
-    printf("[iperf] Raw length bytes: 0x%02X 0x%02X 0x%02X 0x%02X, Parsed length: %d\n", raw_len[0], raw_len[1], raw_len[2], raw_len[3], len);
-#endif
-
-    recv(SOCKET_CTRL, (uint8_t *)buffer, len);
-    buffer[len] = '\0'; // Null-terminate
-
-#ifdef IPERF_DEBUG
-    printf("[iperf] Received parameters: %s\n", buffer);
+    switch (c)
+    {
+#if (_WIZCHIP_ == W5500)
+    case 'm':
+        flag = Sn_MR_MFEN;
+        break;
+    case 'b':
+        flag = Sn_MR_BCASTB;
+        break;
+    case 'c':
+        flag = Sn_MR_MMB;
+        break;
+    case '6':
+        flag = Sn_MR_MIP6B;
+        break;
 #endif
+    case 's':
+        netif_macraw_stats_print();
+        return;
+    default:
+        return;
+    }
 
-    json = cJSON_Parse(buffer);
-    if (json == NULL)
+#if LWIP_DUAL_CORE
+    // Core 1 checks its own test state and stops handing frames over before the socket is reopened
+    if (g_filter_state == MACRAW_FILTER_NONE)
     {
-        printf("[iperf] Failed to parse JSON: %s\n", cJSON_GetErrorPtr());
+        g_filter_flag = flag;
+        __mem_fence_release();
+        g_filter_state = MACRAW_FILTER_REQUESTED;
     }
-    else
+#else
+    if (!iperf_lwip_idle())
     {
-        reverseItem = cJSON_GetObjectItem(json, "reverse");
-
-        *reverse = (reverseItem && cJSON_IsBool(reverseItem)) ? reverseItem->valueint : 0;
+        printf("[iperf] The MACRAW filter can only be changed between tests\n");
+        return;
+    }
 
-#ifdef IPERF_DEBUG
-        printf("[iperf] Parsed JSON: %s\n", cJSON_Print(json));
-        printf("[iperf] Parsed JSON: reverse=%d\n", *reverse);
+    macraw_filter_apply(flag);
 #endif
-        cJSON_Delete(json);
-    }
 }
 
-void handle_create_streams(void)
+static void macraw_filter_apply(uint8_t flag)
 {
-    int8_t retval = 0;
-    uint8_t cmd = CREATE_STREAMS;
-    uint8_t received = 0;
-
-    send(SOCKET_CTRL, &cmd, 1);
-
-    retval = socket(SOCKET_DATA, Sn_MR_MACRAW, PORT_IPERF, 0x20);
-
-    if (retval < 0)
+    if (netif_macraw_open(SOCKET_MACRAW, netif_macraw_filter() ^ flag) < 0)
     {
         printf(" MACRAW socket open failed\n");
     }
+    netif_macraw_stats_print();
+}
 
-        // Set the default interface and bring it up
-    netif_set_link_up(&g_netif);
-    netif_set_up(&g_netif);
-
-    lwiperf_start_tcp_server_default(fn, NULL);
-    
-    received = recv_lwip(SOCKET_DATA, cookie, COOKIE_SIZE);
-
-#ifdef IPERF_DEBUG
-    if (received > 0)
+#if LWIP_DUAL_CORE
+/* Core 0 : reopen the socket once core 1 waits, frames keep being sent and received meanwhile */
+static void macraw_filter_poll(void)
+{
+    switch (g_filter_state)
     {
-        printf("[iperf] Received data cookie: %s\n", cookie);
+    case MACRAW_FILTER_PAUSED:
+        __mem_fence_acquire();
+        macraw_filter_apply(g_filter_flag);
+
+        __mem_fence_release();
+        g_filter_state = MACRAW_FILTER_DONE;
+        break;
+    case MACRAW_FILTER_BUSY:
+        printf("[iperf] The MACRAW filter can only be changed between tests\n");
+
+        g_filter_state = MACRAW_FILTER_NONE;
+        break;
+    default:
+        break;
     }
-#endif
 }
 
-void start_iperf_test(Stats *stats, bool reverse)
+/* Core 1 : wait outside of lwIP while core 0 reopens the socket, so no test can start and no frame is handed over */
+static void macraw_filter_pause(void)
 {
-    uint8_t cmd = 0;
-    uint16_t sent_bytes = 0;
-    uint16_t recv_bytes = 0;
-    uint8_t *pack = malloc(ETHERNET_BUF_MAX_SIZE);
-    uint16_t pack_len = 0;
-    struct pbuf *p = NULL;
-    uint32_t total_recv = 0;
-
-    // Start test
-    cmd = TEST_START;
-    send(SOCKET_CTRL, &cmd, 1);
-
-    // Running test
-    cmd = TEST_RUNNING;
-    send(SOCKET_CTRL, &cmd, 1);
-
-    iperf_stats_start(stats);
-
-    while (stats->running)
+    if (g_filter_state != MACRAW_FILTER_REQUESTED)
     {
-        if (getSn_RX_RSR(SOCKET_CTRL) > 0)
-        {
-            recv(SOCKET_CTRL, &cmd, 1);
-            if (cmd == TEST_END)
-            {
-                stats->running = false;
-                break;
-            }
-        }
-
-        if (reverse)
-        {
-            sent_bytes = send(SOCKET_DATA, g_iperf_buf, ETHERNET_BUF_MAX_SIZE / 2);
-            iperf_stats_add_bytes(stats, sent_bytes);
-        }
-        else
-        {
-            getsockopt(SOCKET_DATA, SO_RECVBUF, &pack_len);
+        return;
+    }
 
-            if (pack_len > 0)
-            {
-                recv_bytes = recv_lwip(SOCKET_DATA, (uint8_t *)pack, ETHERNET_BUF_MAX_SIZE - 1);
-
-                if (recv_bytes)
-                {
-                    p = pbuf_alloc(PBUF_RAW, recv_bytes, PBUF_POOL);
-                    pbuf_take(p, pack, recv_bytes);
-                    free(pack);
-
-                    pack = malloc(ETHERNET_BUF_MAX_SIZE);
-                }
-                else
-                {
-                    printf(" No packet received\n");
-                }
-
-                if (recv_bytes && p != NULL)
-                {
-                    LINK_STATS_INC(link.recv);
-
-                    if (g_netif.input(p, &g_netif) != ERR_OK)
-                    {
-                        pbuf_free(p);
-                    }
-                }
-                iperf_stats_add_bytes(stats, recv_bytes);
-            }
-            else if (pack_len == 0)
-            {
-                iperf_stats_update(stats, false);
-            }
-            else
-            {
-                printf("[iperf] Error during data reception\n");
-                break;
-            }
-        }
-        iperf_stats_update(stats, false);
+    if (!iperf_lwip_idle())
+    {
+        g_filter_state = MACRAW_FILTER_BUSY;
+        return;
+    }
 
-        /* Cyclic lwIP timers check */
-        sys_check_timeouts();
+    g_filter_state = MACRAW_FILTER_PAUSED;
+    while (g_filter_state != MACRAW_FILTER_DONE)
+    {
+        tight_loop_contents();
     }
-    iperf_stats_stop(stats);
+    __mem_fence_acquire();
 
-    exchange_results(stats);
+    g_filter_state = MACRAW_FILTER_NONE;
 }
+#endif
 
-void exchange_results(Stats *stats) 
+/* LWIP */
+#if LWIP_DUAL_CORE
+static void core1_entry(void)
 {
-    uint8_t cmd = EXCHANGE_RESULTS;
-    uint32_t result_len = 0;
-    uint8_t length_bytes[4];
-    char buffer[1024];
-    char *results_str;
-    uint32_t results_len;
-    cJSON *results;
-    cJSON *streams;
-    cJSON *stream;
-
-    // Ask to exchange results
-    send(SOCKET_CTRL, &cmd, 1);
-
-    // Receive client results
-    recv(SOCKET_CTRL, (uint8_t *)&result_len, 4);
-    result_len = (result_len << 24) | ((result_len << 8) & 0x00FF0000) | ((result_len >> 8) & 0x0000FF00) | (result_len >> 24); // Convert to host-endian
-
-    if (result_len > sizeof(buffer))
+    while (1)
     {
-        printf("[iperf] Received result length exceeds buffer size.\n");
-        return;
-    }
+        netif_rx_process(&g_netif);
 
-    recv(SOCKET_CTRL, (uint8_t *)buffer, result_len);
-    buffer[result_len] = '\0'; // Null-terminate the received JSON data
-#ifdef IPERF_DEBUG
-    printf("[iperf] Client results received: %s\n", buffer);
-#endif
+        /* Cyclic lwIP timers check */
+        sys_check_timeouts();
 
-    // Prepare server results
-    results = cJSON_CreateObject();
-    cJSON_AddNumberToObject(results, "cpu_util_total", 0);
-    cJSON_AddNumberToObject(results, "cpu_util_user", 0);
-    cJSON_AddNumberToObject(results, "cpu_util_system", 0);
-    cJSON_AddNumberToObject(results, "sender_has_retransmits", 0);
-
-    // Streams object
-    streams = cJSON_CreateArray();
-    stream = cJSON_CreateObject();
-    cJSON_AddNumberToObject(stream, "id", 1);
-    cJSON_AddNumberToObject(stream, "bytes", stats->nb0);
-    cJSON_AddNumberToObject(stream, "retransmits", -1);
-    cJSON_AddNumberToObject(stream, "jitter", 0);
-    cJSON_AddNumberToObject(stream, "errors", 0);
-    cJSON_AddNumberToObject(stream, "packets", stats->np0);
-    cJSON_AddNumberToObject(stream, "start_time", 0);
-    cJSON_AddNumberToObject(stream, "end_time", (double)(stats->t3 - stats->t0) / 1000000.0);
-    cJSON_AddItemToArray(streams, stream);
-    cJSON_AddItemToObject(results, "streams", streams);
-
-    // Serialize JSON to string
-    results_str = cJSON_PrintUnformatted(results);
-    results_len = strlen(results_str);
-
-    // Send server results
-    length_bytes[0] = (results_len >> 24) & 0xFF;
-    length_bytes[1] = (results_len >> 16) & 0xFF;
-    length_bytes[2] = (results_len >> 8) & 0xFF;
-    length_bytes[3] = results_len & 0xFF;
-
-    send(SOCKET_CTRL, length_bytes, 4);
-    send(SOCKET_CTRL, (uint8_t *)results_str, results_len);
-
-    cJSON_Delete(results);
-
-    // Ask to display results
-    cmd = DISPLAY_RESULTS;
-    send(SOCKET_CTRL, &cmd, 1);
-
-    // Wait for IPERF_DONE command
-    recv(SOCKET_CTRL, &cmd, 1);
-    if (cmd == IPERF_DONE)
-    {
-        printf("[iperf] Test completed successfully.\n");
-    }
-    else
-    {
-        printf("[iperf] Unexpected command received: %d\n", cmd);
+        iperf_lwip_process();
+
+        macraw_filter_pause();
     }
 }
+#endif
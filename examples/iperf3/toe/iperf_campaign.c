@@ -0,0 +1,311 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "iperf.h"
+#include "iperf_client.h"
+#include "iperf_campaign.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Rates are kept in units of 10 kbits/sec */
+#define RATE_UNIT_BPS 10000
+#define RATE_MAX 0xFFFF
+
+/* Flags of a combination, without the outcome */
+#define RESULT_KEY_FLAGS (IPERF_CAMPAIGN_RESULT_UDP | IPERF_CAMPAIGN_RESULT_REVERSE | IPERF_CAMPAIGN_RESULT_SERVER)
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Results */
+static iperf_campaign_result_t g_results[IPERF_CAMPAIGN_MAX_RESULTS];
+static uint16_t g_num_results = 0;
+static uint16_t g_num_dropped = 0; // Tests run once the results were full
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+static uint8_t iperf_campaign_values(const void *list, uint8_t size);
+static uint16_t iperf_campaign_rate(double bps);
+static void iperf_campaign_add(const iperf_campaign_result_t *result);
+static bool iperf_campaign_same(const iperf_campaign_result_t *a, const iperf_campaign_result_t *b);
+
+void iperf_campaign_initialize(void)
+{
+    memset(g_results, 0, sizeof(g_results));
+    g_num_results = 0;
+    g_num_dropped = 0;
+}
+
+void iperf_campaign_run(const iperf_campaign_config_t *config)
+{
+    iperf_client_config_t client = {0};
+    iperf_client_result_t client_result;
+    iperf_campaign_result_t result;
+    uint8_t num_blksizes = iperf_campaign_values(config->blksizes, sizeof(config->blksizes[0]));
+    uint8_t num_parallels = iperf_campaign_values(config->parallels, sizeof(config->parallels[0]));
+    uint8_t num_bandwidths = iperf_campaign_values(config->bandwidths, sizeof(config->bandwidths[0]));
+    uint8_t repeat = config->repeat ? config->repeat : 1;
+    uint16_t total = 0;
+    uint16_t run = 0;
+    uint64_t packets = 0;
+
+    for (uint8_t proto = 0; proto < 2; proto++)
+    {
+        for (uint8_t dir = 0; dir < 2; dir++)
+        {
+            if ((config->protocols & (1 << proto)) && (config->directions & (1 << dir)))
+            {
+                total += num_blksizes * num_parallels * num_bandwidths * repeat;
+            }
+        }
+    }
+
+    printf("[iperf] Campaign of %d tests, %d sec each\n", total, config->time);
+
+    iperf_campaign_initialize();
+
+    memcpy(client.server_ip, config->server_ip, 4);
+    client.port = config->port;
+    client.time = config->time;
+
+    for (uint8_t proto = 0; proto < 2; proto++)
+    {
+        if (!(config->protocols & (1 << proto)))
+        {
+            continue;
+        }
+
+        for (uint8_t dir = 0; dir < 2; dir++)
+        {
+            if (!(config->directions & (1 << dir)))
+            {
+                continue;
+            }
+
+            for (uint8_t b = 0; b < num_blksizes; b++)
+            {
+                for (uint8_t p = 0; p < num_parallels; p++)
+                {
+                    for (uint8_t r = 0; r < num_bandwidths; r++)
+                    {
+                        client.udp = (proto == 1);
+                        client.reverse = (dir == 1);
+                        client.blksize = config->blksizes[b];
+                        client.parallel = config->parallels[p] ? config->parallels[p] : 1;
+                        client.bandwidth = config->bandwidths[r];
+                        if (client.udp && client.bandwidth == 0)
+                        {
+                            client.bandwidth = IPERF_CLIENT_UDP_BANDWIDTH;
+                        }
+
+                        for (uint8_t i = 0; i < repeat; i++)
+                        {
+                            printf("[iperf] Campaign test %d/%d\n", ++run, total);
+
+                            iperf_client_run(&client, &client_result);
+
+                            memset(&result, 0, sizeof(result));
+                            result.flags = (client.udp ? IPERF_CAMPAIGN_RESULT_UDP : 0) |
+                                           (client.reverse ? IPERF_CAMPAIGN_RESULT_REVERSE : 0) |
+                                           (client_result.ok ? IPERF_CAMPAIGN_RESULT_OK : 0);
+                            result.parallel = client.parallel;
+                            result.blksize = client.blksize;
+                            result.bandwidth = iperf_campaign_rate(client.bandwidth);
+
+                            if (client_result.ok && client_result.seconds > 0)
+                            {
+                                result.device = iperf_campaign_rate(client_result.bytes * 8 / client_result.seconds);
+                                result.server = iperf_campaign_rate(client_result.server_bytes * 8 / client_result.seconds);
+                            }
+
+                            // The receiving side counts the datagrams of a UDP test
+                            packets = client.reverse ? client_result.packets + client_result.errors : client_result.server_packets;
+                            if (packets > 0)
+                            {
+                                result.loss = (uint16_t)(client_result.errors * 10000 / packets);
+                            }
+                            result.jitter_us = (client_result.jitter_ms * 1000 > RATE_MAX) ? RATE_MAX : (uint16_t)(client_result.jitter_ms * 1000);
+
+                            iperf_campaign_add(&result);
+
+                            if (run < total)
+                            {
+                                sleep_ms(config->pause_ms);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    iperf_campaign_summary();
+}
+
+uint16_t iperf_campaign_record(const iperf_params_t *params, const Stats *stats, bool ok)
+{
+    iperf_campaign_result_t result;
+    double seconds = (stats->t3 - stats->t0) / 1e6;
+
+    memset(&result, 0, sizeof(result));
+    result.flags = IPERF_CAMPAIGN_RESULT_SERVER |
+                   (params->udp ? IPERF_CAMPAIGN_RESULT_UDP : 0) |
+                   (params->reverse ? IPERF_CAMPAIGN_RESULT_REVERSE : 0) |
+                   (ok ? IPERF_CAMPAIGN_RESULT_OK : 0);
+    result.parallel = (params->parallel > 0) ? (uint8_t)params->parallel : 1;
+    result.blksize = params->len;
+    result.bandwidth = iperf_campaign_rate(params->bandwidth);
+    if (seconds > 0)
+    {
+        result.device = iperf_campaign_rate(stats->nb0 * 8 / seconds);
+    }
+
+    iperf_campaign_add(&result);
+
+    return g_num_results;
+}
+
+void iperf_campaign_summary(void)
+{
+    const iperf_campaign_result_t *first = NULL;
+    const iperf_campaign_result_t *result = NULL;
+    uint16_t failed = 0;
+    uint16_t runs = 0;
+    uint16_t ok = 0;
+    uint16_t min = 0;
+    uint16_t max = 0;
+    uint32_t sum = 0;
+    uint32_t server_sum = 0;
+    uint32_t loss_sum = 0;
+    uint16_t jitter_max = 0;
+
+    printf("[iperf] Campaign summary\n");
+    printf(" Role   Proto Dir      -P     -l    -b Mbps Runs Fail  Device Mbps min/avg/max    Server Mbps  Loss %%  Jitter ms\n");
+
+    for (uint16_t i = 0; i < g_num_results; i += runs)
+    {
+        first = &g_results[i];
+        runs = 0;
+        ok = 0;
+        min = RATE_MAX;
+        max = 0;
+        sum = 0;
+        server_sum = 0;
+        loss_sum = 0;
+        jitter_max = 0;
+
+        // Repeated runs of a combination are recorded one after the other
+        for (uint16_t j = i; j < g_num_results && iperf_campaign_same(first, &g_results[j]); j++)
+        {
+            result = &g_results[j];
+            runs++;
+
+            if (!(result->flags & IPERF_CAMPAIGN_RESULT_OK))
+            {
+                continue;
+            }
+
+            ok++;
+            min = (result->device < min) ? result->device : min;
+            max = (result->device > max) ? result->device : max;
+            sum += result->device;
+            server_sum += result->server;
+            loss_sum += result->loss;
+            jitter_max = (result->jitter_us > jitter_max) ? result->jitter_us : jitter_max;
+        }
+        failed += runs - ok;
+
+        printf(" %-6s %-5s %-8s %2d %6d %10.2f %4d %4d",
+               (first->flags & IPERF_CAMPAIGN_RESULT_SERVER) ? "server" : "client",
+               (first->flags & IPERF_CAMPAIGN_RESULT_UDP) ? "UDP" : "TCP",
+               (first->flags & IPERF_CAMPAIGN_RESULT_REVERSE) ? "reverse" : "forward",
+               first->parallel, first->blksize, first->bandwidth / 100.0, runs, runs - ok);
+
+        if (ok == 0)
+        {
+            printf("\n");
+            continue;
+        }
+
+        printf("  %7.2f/%7.2f/%7.2f  %11.2f  %6.2f  %9.3f\n",
+               min / 100.0, sum / 100.0 / ok, max / 100.0, server_sum / 100.0 / ok,
+               loss_sum / 100.0 / ok, jitter_max / 1000.0);
+    }
+
+    printf("[iperf] Campaign : %d tests, %d failed", g_num_results + g_num_dropped, failed);
+    if (g_num_dropped > 0)
+    {
+        printf(", %d not kept", g_num_dropped);
+    }
+    printf("\n");
+}
+
+/* Number of values of an axis, at least one */
+static uint8_t iperf_campaign_values(const void *list, uint8_t size)
+{
+    const uint8_t *value = (const uint8_t *)list;
+    uint8_t count = 0;
+
+    while (count < IPERF_CAMPAIGN_MAX_VALUES)
+    {
+        bool zero = true;
+
+        for (uint8_t i = 0; i < size; i++)
+        {
+            zero = zero && (value[count * size + i] == 0);
+        }
+
+        if (zero)
+        {
+            break;
+        }
+        count++;
+    }
+
+    return count ? count : 1;
+}
+
+static uint16_t iperf_campaign_rate(double bps)
+{
+    double rate = bps / RATE_UNIT_BPS + 0.5;
+
+    return (rate > RATE_MAX) ? RATE_MAX : (uint16_t)rate;
+}
+
+static void iperf_campaign_add(const iperf_campaign_result_t *result)
+{
+    if (g_num_results >= IPERF_CAMPAIGN_MAX_RESULTS)
+    {
+        g_num_dropped++;
+        return;
+    }
+
+    g_results[g_num_results++] = *result;
+}
+
+static bool iperf_campaign_same(const iperf_campaign_result_t *a, const iperf_campaign_result_t *b)
+{
+    return ((a->flags ^ b->flags) & RESULT_KEY_FLAGS) == 0 &&
+           a->parallel == b->parallel && a->blksize == b->blksize && a->bandwidth == b->bandwidth;
+}
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _IPERF_CAMPAIGN_H_
+#define _IPERF_CAMPAIGN_H_
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "iperf.h"
+#include "iperf_params.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Matrix, protocols and directions to run */
+#define IPERF_CAMPAIGN_TCP (1 << 0)
+#define IPERF_CAMPAIGN_UDP (1 << 1)
+#define IPERF_CAMPAIGN_FORWARD (1 << 0)
+#define IPERF_CAMPAIGN_REVERSE (1 << 1)
+
+/* Values per matrix axis */
+#define IPERF_CAMPAIGN_MAX_VALUES 4
+
+/* Results kept on the device, 16 bytes each */
+#define IPERF_CAMPAIGN_MAX_RESULTS 64
+
+/* Result flags */
+#define IPERF_CAMPAIGN_RESULT_UDP 0x01
+#define IPERF_CAMPAIGN_RESULT_REVERSE 0x02
+#define IPERF_CAMPAIGN_RESULT_OK 0x04
+#define IPERF_CAMPAIGN_RESULT_SERVER 0x08 // Recorded in the server role
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Campaign of the client role, every combination of the axes is run. An axis list ends at its first 0,
+   a list starting with 0 runs the default once */
+typedef struct
+{
+    uint8_t server_ip[4];
+    uint16_t port;
+    uint8_t protocols;                              // IPERF_CAMPAIGN_TCP, IPERF_CAMPAIGN_UDP
+    uint8_t directions;                             // IPERF_CAMPAIGN_FORWARD, IPERF_CAMPAIGN_REVERSE
+    uint16_t blksizes[IPERF_CAMPAIGN_MAX_VALUES];   // -l
+    uint8_t parallels[IPERF_CAMPAIGN_MAX_VALUES];   // -P
+    uint32_t bandwidths[IPERF_CAMPAIGN_MAX_VALUES]; // -b in bits/sec
+    uint16_t time;                                  // -t of every test
+    uint8_t repeat;                                 // Runs of every combination
+    uint32_t pause_ms;                              // Pause between tests
+} iperf_campaign_config_t;
+
+/* Result of one test, rates in units of 10 kbits/sec */
+typedef struct
+{
+    uint32_t blksize;   // 0 if unknown
+    uint8_t flags;      // IPERF_CAMPAIGN_RESULT_...
+    uint8_t parallel;
+    uint16_t bandwidth; // Requested rate, 0 for unlimited
+    uint16_t device;    // Rate seen by the device
+    uint16_t server;    // Rate seen by the server, 0 if unknown
+    uint16_t loss;      // Lost datagrams in 1/100 %
+    uint16_t jitter_us;
+} iperf_campaign_result_t;
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/*! \brief Initialize iperf campaign
+ *  \ingroup iperf_campaign
+ *
+ *  Clear the results kept on the device.
+ *
+ *  \param none
+ */
+void iperf_campaign_initialize(void);
+
+/*! \brief Run a campaign as the client
+ *  \ingroup iperf_campaign
+ *
+ *  Run every combination of protocol, direction, block size, stream count and rate, repeat times each,
+ *  against the iperf3 server, keep the result of each test and print the campaign summary.
+ *  The iperf3 client must be initialized.
+ *
+ *  \param config campaign to run
+ */
+void iperf_campaign_run(const iperf_campaign_config_t *config);
+
+/*! \brief Record a test run in the server role
+ *  \ingroup iperf_campaign
+ *
+ *  Keep the result of a test the server has run, from the parameters the client sent and its statistics.
+ *
+ *  \param params parameters of the test, as parsed from the client
+ *  \param stats statistics of the test
+ *  \param ok the test completed
+ *  \return number of results kept
+ */
+uint16_t iperf_campaign_record(const iperf_params_t *params, const Stats *stats, bool ok);
+
+/*! \brief Print the campaign summary
+ *  \ingroup iperf_campaign
+ *
+ *  Print one line per combination, with the repeated runs of a combination folded into
+ *  the minimum, average and maximum rates, and the totals of the campaign.
+ *
+ *  \param none
+ */
+void iperf_campaign_summary(void);
+
+#endif /* _IPERF_CAMPAIGN_H_ */
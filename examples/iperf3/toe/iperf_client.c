@@ -0,0 +1,748 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "wizchip_conf.h"
+#include "w5x00_spi.h"
+
+#include "socket.h"
+
+#include "cJSON.h" // JSON handling library
+#include "iperf.h"
+#include "iperf_arena.h"
+#include "iperf_client.h"
+#include "iperf_json.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Socket */
+#define SOCKET_CTRL 1
+
+/* Local ports, a new one per connection so a server never sees a port of the last test again */
+#define PORT_LOCAL_BASE 50000
+#define PORT_LOCAL_NUM 10000
+
+/* Cookie size */
+#define COOKIE_SIZE 37
+
+/* Buffer */
+#define CTRL_BUF_MAX_SIZE (1024 * 4)
+
+/* Socket buffer of the control connection, in KB per direction */
+#define BUF_CTRL_KB 1
+
+/* iperf3 Commands */
+#define TEST_START 1
+#define TEST_RUNNING 2
+#define TEST_END 4
+#define PARAM_EXCHANGE 9
+#define CREATE_STREAMS 10
+#define SERVER_TERMINATE 11
+#define EXCHANGE_RESULTS 13
+#define DISPLAY_RESULTS 14
+#define IPERF_DONE 16
+#define ACCESS_DENIED (-1)
+#define SERVER_ERROR (-2)
+
+/* UDP */
+#define UDP_CONNECT_MSG 0x36373839
+#define UDP_HEADER_SIZE 12
+#define UDP_PAYLOAD_MAX_SIZE 1472
+
+/* Timeouts */
+#define CTRL_TIMEOUT_MS 10000
+#define UDP_CONNECT_TIMEOUT_MS 3000
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Stream */
+typedef struct
+{
+    uint8_t sn;
+    uint8_t id;           // iperf3 numbers streams 1, 3, 4, ...
+    uint64_t bytes;
+    uint64_t packets;
+    uint32_t pcount;      // Last datagram number sent, or highest received
+    uint32_t errors;
+    Jitter jitter;
+} iperf_client_stream_t;
+
+/* Sockets of the streams, socket 1 is the control connection */
+static const uint8_t g_data_sockets[IPERF_CLIENT_MAX_STREAMS] = {
+    0, 2, 3,
+#if IPERF_CLIENT_MAX_STREAMS > 3
+    4,
+#endif
+};
+
+/* Test */
+static iperf_client_stream_t g_streams[IPERF_CLIENT_MAX_STREAMS];
+static uint8_t g_num_streams = 0;
+static iperf_client_config_t g_config;
+static uint8_t g_cookie[COOKIE_SIZE] = {0};
+static uint16_t g_local_port = 0;
+static Stats g_stats;
+
+/* Buffer */
+static uint8_t *g_buf = NULL;
+static uint32_t g_buf_size = 0;
+static char g_ctrl_buf[CTRL_BUF_MAX_SIZE + 1];
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Control */
+static uint16_t iperf_client_port(void);
+static void iperf_client_buffers(uint8_t streams);
+static bool iperf_client_read(uint8_t *buf, uint16_t len, uint32_t timeout_ms);
+static bool iperf_client_expect(int8_t state);
+static bool iperf_client_send_state(int8_t state);
+static bool iperf_client_send_json(cJSON *json);
+static bool iperf_client_send_params(void);
+static bool iperf_client_send_results(void);
+static void iperf_client_write(void *arg, const void *data, uint32_t len);
+static bool iperf_client_get_results(iperf_client_result_t *result);
+static void iperf_client_close(void);
+
+/* Streams */
+static bool iperf_client_create_streams(void);
+static void iperf_client_send(iperf_client_stream_t *stream, uint64_t elapsed_us);
+static void iperf_client_recv(iperf_client_stream_t *stream);
+static void iperf_client_udp_account(iperf_client_stream_t *stream, const uint8_t *buf);
+static bool iperf_client_test(void);
+
+void iperf_client_initialize(uint8_t *buf, uint32_t size)
+{
+    g_buf = buf;
+    g_buf_size = size;
+    g_local_port = (uint16_t)(time_us_32() % PORT_LOCAL_NUM);
+
+    iperf_stats_init(&g_stats, 1000);
+
+    // The JSON of the tests never allocates from the heap, server builds do not link the arena
+    iperf_arena_initialize();
+}
+
+int8_t iperf_client_run(const iperf_client_config_t *config, iperf_client_result_t *result)
+{
+    static const char cookie_chars[] = "abcdefghijklmnopqrstuvwxyz234567";
+    bool ok = false;
+
+    memset(result, 0, sizeof(iperf_client_result_t));
+
+    g_config = *config;
+    if (g_config.parallel == 0)
+    {
+        g_config.parallel = 1;
+    }
+    if (g_config.parallel > IPERF_CLIENT_MAX_STREAMS)
+    {
+        printf("[iperf] %d streams requested, %d used\n", g_config.parallel, IPERF_CLIENT_MAX_STREAMS);
+        g_config.parallel = IPERF_CLIENT_MAX_STREAMS;
+    }
+    if (g_config.blksize == 0)
+    {
+        g_config.blksize = g_config.udp ? IPERF_CLIENT_UDP_BLKSIZE : IPERF_CLIENT_TCP_BLKSIZE;
+    }
+    if (g_config.udp && g_config.blksize > UDP_PAYLOAD_MAX_SIZE)
+    {
+        g_config.blksize = UDP_PAYLOAD_MAX_SIZE;
+    }
+    if (g_config.blksize > g_buf_size)
+    {
+        g_config.blksize = g_buf_size;
+    }
+
+    iperf_client_buffers(g_config.parallel);
+
+    // A block larger than the TX buffer of a stream never finds room in it
+    if (g_config.blksize > getSn_TxMAX(g_data_sockets[0]))
+    {
+        printf("[iperf] %d bytes blocks requested, %d used\n", g_config.blksize, getSn_TxMAX(g_data_sockets[0]));
+        g_config.blksize = getSn_TxMAX(g_data_sockets[0]);
+    }
+
+    // Same cookie format as iperf3 : 36 characters and a terminating zero
+    srand(time_us_32());
+    for (uint8_t i = 0; i < COOKIE_SIZE - 1; i++)
+    {
+        g_cookie[i] = cookie_chars[rand() % (sizeof(cookie_chars) - 1)];
+    }
+    g_cookie[COOKIE_SIZE - 1] = '\0';
+
+    printf("[iperf] Connecting to %d.%d.%d.%d:%d, %s%s, %d streams, %d bytes, %d sec\n",
+           g_config.server_ip[0], g_config.server_ip[1], g_config.server_ip[2], g_config.server_ip[3], g_config.port,
+           g_config.udp ? "UDP" : "TCP", g_config.reverse ? " reverse" : "", g_config.parallel,
+           g_config.blksize, g_config.time);
+
+    socket(SOCKET_CTRL, Sn_MR_TCP, iperf_client_port(), 0x00);
+    if (connect(SOCKET_CTRL, g_config.server_ip, g_config.port) != SOCK_OK)
+    {
+        printf("[iperf] Failed to connect to the server\n");
+        close(SOCKET_CTRL);
+        return -1;
+    }
+
+    ok = send(SOCKET_CTRL, g_cookie, COOKIE_SIZE) == COOKIE_SIZE &&
+         iperf_client_expect(PARAM_EXCHANGE) &&
+         iperf_client_send_params() &&
+         iperf_client_expect(CREATE_STREAMS) &&
+         iperf_client_create_streams() &&
+         iperf_client_expect(TEST_START) &&
+         iperf_client_expect(TEST_RUNNING) &&
+         iperf_client_test() &&
+         iperf_client_expect(EXCHANGE_RESULTS) &&
+         iperf_client_send_results() &&
+         iperf_client_get_results(result) &&
+         iperf_client_expect(DISPLAY_RESULTS) &&
+         iperf_client_send_state(IPERF_DONE);
+
+    result->ok = ok;
+    result->seconds = (g_stats.t3 - g_stats.t0) / 1e6;
+    result->bytes = g_stats.nb0;
+    result->packets = g_stats.np0;
+
+    // The receiving side counts losses and jitter
+    if (g_config.udp && g_config.reverse)
+    {
+        result->errors = 0;
+        result->jitter_ms = 0;
+        for (uint8_t i = 0; i < g_num_streams; i++)
+        {
+            result->errors += g_streams[i].errors;
+            if (g_streams[i].jitter.jitter_x16 / 16 / 1000.0 > result->jitter_ms)
+            {
+                result->jitter_ms = g_streams[i].jitter.jitter_x16 / 16 / 1000.0;
+            }
+        }
+    }
+
+    iperf_client_close();
+    iperf_arena_reset();
+
+    if (!ok)
+    {
+        printf("[iperf] Test failed\n");
+        return -1;
+    }
+
+    printf("[iperf] Device : %llu bytes %s in %.2f sec, %.2f Mbits/sec\n",
+           (unsigned long long)result->bytes, g_config.reverse ? "received" : "sent", result->seconds,
+           result->seconds > 0 ? result->bytes * 8 / 1e6 / result->seconds : 0.0);
+    printf("[iperf] Server : %llu bytes %s, %.2f Mbits/sec",
+           (unsigned long long)result->server_bytes, g_config.reverse ? "sent" : "received",
+           result->seconds > 0 ? result->server_bytes * 8 / 1e6 / result->seconds : 0.0);
+    if (g_config.udp)
+    {
+        printf(", %llu/%llu datagrams lost, jitter %.3f ms",
+               (unsigned long long)result->errors,
+               (unsigned long long)(g_config.reverse ? result->server_packets : result->packets), result->jitter_ms);
+    }
+    printf("\n");
+
+    return 0;
+}
+
+/* Control */
+static uint16_t iperf_client_port(void)
+{
+    g_local_port = (g_local_port + 1) % PORT_LOCAL_NUM;
+
+    return PORT_LOCAL_BASE + g_local_port;
+}
+
+/* Socket buffer sizes can only be changed while the sockets are closed */
+static void iperf_client_buffers(uint8_t streams)
+{
+    uint8_t kb = wizchip_buf_kb(WIZCHIP_BUF_TOTAL_KB - BUF_CTRL_KB, streams);
+
+    close(SOCKET_CTRL);
+    setSn_RXBUF_SIZE(SOCKET_CTRL, BUF_CTRL_KB);
+    setSn_TXBUF_SIZE(SOCKET_CTRL, BUF_CTRL_KB);
+
+    for (uint8_t i = 0; i < IPERF_CLIENT_MAX_STREAMS; i++)
+    {
+        close(g_data_sockets[i]);
+        setSn_RXBUF_SIZE(g_data_sockets[i], i < streams ? kb : 0);
+        setSn_TXBUF_SIZE(g_data_sockets[i], i < streams ? kb : 0);
+    }
+}
+
+/* Read exactly len bytes from the control connection */
+static bool iperf_client_read(uint8_t *buf, uint16_t len, uint32_t timeout_ms)
+{
+    uint64_t deadline_us = time_us_64() + (uint64_t)timeout_ms * 1000;
+    uint16_t received = 0;
+    uint16_t rsr = 0;
+    int32_t ret = 0;
+
+    while (received < len)
+    {
+        rsr = getSn_RX_RSR(SOCKET_CTRL);
+
+        if (rsr > 0)
+        {
+            if (rsr > len - received)
+            {
+                rsr = len - received;
+            }
+            ret = recv(SOCKET_CTRL, buf + received, rsr);
+            if (ret <= 0)
+            {
+                return false;
+            }
+            received += ret;
+            continue;
+        }
+
+        // In a reverse test the server keeps sending until it has seen TEST_END, so the streams are drained meanwhile
+        for (uint8_t i = 0; i < g_num_streams; i++)
+        {
+            iperf_client_recv(&g_streams[i]);
+        }
+
+        if (getSn_SR(SOCKET_CTRL) != SOCK_ESTABLISHED || time_us_64() > deadline_us)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool iperf_client_expect(int8_t state)
+{
+    int8_t received = 0;
+
+    if (!iperf_client_read((uint8_t *)&received, 1, CTRL_TIMEOUT_MS))
+    {
+        printf("[iperf] No answer from the server, state %d expected\n", state);
+        return false;
+    }
+
+    if (received != state)
+    {
+        if (received == ACCESS_DENIED)
+        {
+            printf("[iperf] The server is busy running a test\n");
+        }
+        else
+        {
+            printf("[iperf] Unexpected state %d, state %d expected\n", received, state);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static bool iperf_client_send_state(int8_t state)
+{
+    return send(SOCKET_CTRL, (uint8_t *)&state, 1) == 1;
+}
+
+/* Length in network byte order, then the JSON text */
+static bool iperf_client_send_json(cJSON *json)
+{
+    char *str = cJSON_PrintUnformatted(json);
+    uint32_t len = 0;
+    uint8_t length_bytes[4];
+    bool ok = false;
+
+    cJSON_Delete(json);
+
+    if (str == NULL)
+    {
+        printf("[iperf] Failed to create JSON\n");
+        return false;
+    }
+
+    len = strlen(str);
+    length_bytes[0] = (len >> 24) & 0xFF;
+    length_bytes[1] = (len >> 16) & 0xFF;
+    length_bytes[2] = (len >> 8) & 0xFF;
+    length_bytes[3] = len & 0xFF;
+
+    ok = send(SOCKET_CTRL, length_bytes, 4) == 4 && send(SOCKET_CTRL, (uint8_t *)str, len) == (int32_t)len;
+
+    cJSON_free(str);
+
+    return ok;
+}
+
+static bool iperf_client_send_params(void)
+{
+    cJSON *params = cJSON_CreateObject();
+
+    if (params == NULL)
+    {
+        return false;
+    }
+
+    cJSON_AddBoolToObject(params, g_config.udp ? "udp" : "tcp", true);
+    cJSON_AddNumberToObject(params, "omit", 0);
+    cJSON_AddNumberToObject(params, "time", g_config.time);
+    cJSON_AddNumberToObject(params, "num", 0);
+    cJSON_AddNumberToObject(params, "blockcount", 0);
+    cJSON_AddNumberToObject(params, "parallel", g_config.parallel);
+    if (g_config.reverse)
+    {
+        cJSON_AddBoolToObject(params, "reverse", true);
+    }
+    cJSON_AddNumberToObject(params, "len", g_config.blksize);
+    if (g_config.udp || g_config.bandwidth != 0)
+    {
+        cJSON_AddNumberToObject(params, "bandwidth", g_config.bandwidth);
+    }
+    cJSON_AddNumberToObject(params, "pacing_timer", 1000);
+    cJSON_AddStringToObject(params, "client_version", "3.9");
+
+    return iperf_client_send_json(params);
+}
+
+static bool iperf_client_send_results(void)
+{
+    iperf_json_stream_t results[IPERF_CLIENT_MAX_STREAMS];
+    bool ok = true;
+
+    for (uint8_t i = 0; i < g_num_streams; i++)
+    {
+        results[i].id = g_streams[i].id;
+        results[i].bytes = g_streams[i].bytes;
+        results[i].retransmits = -1;
+        results[i].jitter_us = g_streams[i].jitter.jitter_x16 / 16;
+        results[i].errors = g_streams[i].errors;
+        results[i].packets = g_streams[i].packets;
+        results[i].start_us = 0;
+        results[i].end_us = g_stats.t3 - g_stats.t0;
+    }
+
+    iperf_json_send_results(results, g_num_streams, g_config.reverse ? -1 : 0, iperf_client_write, &ok);
+
+    return ok;
+}
+
+/* Sink of the results, arg is cleared once a send fails */
+static void iperf_client_write(void *arg, const void *data, uint32_t len)
+{
+    bool *ok = (bool *)arg;
+
+    if (*ok)
+    {
+        *ok = send(SOCKET_CTRL, (uint8_t *)data, len) == (int32_t)len;
+    }
+}
+
+/* The server's view of the test, summed over its streams */
+static bool iperf_client_get_results(iperf_client_result_t *result)
+{
+    uint8_t length_bytes[4];
+    uint32_t len = 0;
+    cJSON *json = NULL;
+    cJSON *streams = NULL;
+    cJSON *stream = NULL;
+    cJSON *item = NULL;
+
+    if (!iperf_client_read(length_bytes, 4, CTRL_TIMEOUT_MS))
+    {
+        return false;
+    }
+
+    len = ((uint32_t)length_bytes[0] << 24) | ((uint32_t)length_bytes[1] << 16) | ((uint32_t)length_bytes[2] << 8) | length_bytes[3];
+    if (len > CTRL_BUF_MAX_SIZE)
+    {
+        printf("[iperf] Server results of %u bytes exceed the buffer size\n", len);
+        return false;
+    }
+
+    if (!iperf_client_read((uint8_t *)g_ctrl_buf, len, CTRL_TIMEOUT_MS))
+    {
+        return false;
+    }
+    g_ctrl_buf[len] = '\0';
+
+#ifdef IPERF_DEBUG
+    printf("[iperf] Server results received: %s\n", g_ctrl_buf);
+#endif
+
+    json = cJSON_Parse(g_ctrl_buf);
+    if (json == NULL)
+    {
+        printf("[iperf] Failed to parse JSON: %s\n", cJSON_GetErrorPtr());
+        return false;
+    }
+
+    streams = cJSON_GetObjectItem(json, "streams");
+    cJSON_ArrayForEach(stream, streams)
+    {
+        if ((item = cJSON_GetObjectItem(stream, "bytes")) != NULL && cJSON_IsNumber(item))
+        {
+            result->server_bytes += (uint64_t)item->valuedouble;
+        }
+        if ((item = cJSON_GetObjectItem(stream, "packets")) != NULL && cJSON_IsNumber(item))
+        {
+            result->server_packets += (uint64_t)item->valuedouble;
+        }
+        if (!g_config.reverse)
+        {
+            if ((item = cJSON_GetObjectItem(stream, "errors")) != NULL && cJSON_IsNumber(item))
+            {
+                result->errors += (uint64_t)item->valuedouble;
+            }
+            if ((item = cJSON_GetObjectItem(stream, "jitter")) != NULL && cJSON_IsNumber(item) &&
+                item->valuedouble * 1000 > result->jitter_ms)
+            {
+                result->jitter_ms = item->valuedouble * 1000;
+            }
+        }
+    }
+
+    cJSON_Delete(json);
+
+    return true;
+}
+
+static void iperf_client_close(void)
+{
+    for (uint8_t i = 0; i < g_num_streams; i++)
+    {
+        if (!g_config.udp)
+        {
+            disconnect(g_streams[i].sn);
+        }
+        close(g_streams[i].sn);
+    }
+    g_num_streams = 0;
+
+    disconnect(SOCKET_CTRL);
+    close(SOCKET_CTRL);
+}
+
+/* Streams */
+static bool iperf_client_create_streams(void)
+{
+    uint32_t msg = UDP_CONNECT_MSG;
+    uint8_t reply[4];
+    uint8_t ip[4];
+    uint16_t port = 0;
+    uint64_t deadline_us = 0;
+
+    for (uint8_t i = 0; i < g_config.parallel; i++)
+    {
+        iperf_client_stream_t *stream = &g_streams[i];
+
+        memset(stream, 0, sizeof(iperf_client_stream_t));
+        stream->sn = g_data_sockets[i];
+        stream->id = (i == 0) ? 1 : i + 2;
+        g_num_streams++;
+
+        if (!g_config.udp)
+        {
+            socket(stream->sn, Sn_MR_TCP, iperf_client_port(), 0x00);
+            if (connect(stream->sn, g_config.server_ip, g_config.port) != SOCK_OK ||
+                send(stream->sn, g_cookie, COOKIE_SIZE) != COOKIE_SIZE)
+            {
+                printf("[iperf] Failed to open stream %d\n", stream->id);
+                return false;
+            }
+            continue;
+        }
+
+        // The server answers the first datagram of each stream, in the same byte order as it was sent
+        socket(stream->sn, Sn_MR_UDP, iperf_client_port(), 0x00);
+        sendto(stream->sn, (uint8_t *)&msg, sizeof(msg), g_config.server_ip, g_config.port);
+
+        deadline_us = time_us_64() + UDP_CONNECT_TIMEOUT_MS * 1000;
+        while (getSn_RX_RSR(stream->sn) == 0)
+        {
+            if (time_us_64() > deadline_us)
+            {
+                printf("[iperf] No answer to the UDP connect of stream %d\n", stream->id);
+                return false;
+            }
+        }
+        recvfrom(stream->sn, reply, sizeof(reply), ip, &port);
+    }
+
+    return true;
+}
+
+static void iperf_client_send(iperf_client_stream_t *stream, uint64_t elapsed_us)
+{
+    uint8_t *buf = g_buf;
+    uint64_t now_us = 0;
+    int32_t sent = 0;
+
+    if (!g_config.udp)
+    {
+        // Do not wait for buffer space, so every stream and the control connection keep being served
+        if (getSn_TX_FSR(stream->sn) < g_config.blksize)
+        {
+            return;
+        }
+
+        sent = send(stream->sn, buf, g_config.blksize);
+    }
+    else
+    {
+        if (g_config.bandwidth != 0 && stream->bytes >= (uint64_t)g_config.bandwidth * elapsed_us / 8000000)
+        {
+            return;
+        }
+
+        now_us = time_us_64();
+        stream->pcount++;
+
+        // Header : send time and datagram number, in network byte order
+        buf[0] = (uint8_t)((now_us / 1000000) >> 24);
+        buf[1] = (uint8_t)((now_us / 1000000) >> 16);
+        buf[2] = (uint8_t)((now_us / 1000000) >> 8);
+        buf[3] = (uint8_t)(now_us / 1000000);
+        buf[4] = (uint8_t)((now_us % 1000000) >> 24);
+        buf[5] = (uint8_t)((now_us % 1000000) >> 16);
+        buf[6] = (uint8_t)((now_us % 1000000) >> 8);
+        buf[7] = (uint8_t)(now_us % 1000000);
+        buf[8] = (uint8_t)(stream->pcount >> 24);
+        buf[9] = (uint8_t)(stream->pcount >> 16);
+        buf[10] = (uint8_t)(stream->pcount >> 8);
+        buf[11] = (uint8_t)stream->pcount;
+
+        sent = sendto(stream->sn, buf, g_config.blksize, g_config.server_ip, g_config.port);
+    }
+
+    if (sent > 0)
+    {
+        stream->bytes += sent;
+        stream->packets++;
+        iperf_stats_add_bytes(&g_stats, sent);
+    }
+}
+
+static void iperf_client_recv(iperf_client_stream_t *stream)
+{
+    uint16_t len = getSn_RX_RSR(stream->sn);
+    uint8_t ip[4];
+    uint16_t port = 0;
+    int32_t received = 0;
+
+    if (len == 0)
+    {
+        return;
+    }
+
+    if (!g_config.udp)
+    {
+        if (len > g_buf_size)
+        {
+            len = g_buf_size;
+        }
+        received = recv_iperf(stream->sn, g_buf, len);
+    }
+    else
+    {
+        received = recvfrom(stream->sn, g_buf, g_buf_size, ip, &port);
+        if (received >= UDP_HEADER_SIZE)
+        {
+            iperf_client_udp_account(stream, g_buf);
+        }
+    }
+
+    if (received > 0)
+    {
+        stream->bytes += received;
+        stream->packets++;
+        if (g_stats.running)
+        {
+            iperf_stats_add_bytes(&g_stats, received);
+        }
+    }
+}
+
+static void iperf_client_udp_account(iperf_client_stream_t *stream, const uint8_t *buf)
+{
+    uint32_t sec = ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+    uint32_t usec = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) | ((uint32_t)buf[6] << 8) | buf[7];
+    uint32_t pcount = ((uint32_t)buf[8] << 24) | ((uint32_t)buf[9] << 16) | ((uint32_t)buf[10] << 8) | buf[11];
+
+    // Loss and reordering, counted like the iperf3 receiver does
+    if (pcount >= stream->pcount + 1)
+    {
+        if (pcount > stream->pcount + 1)
+        {
+            stream->errors += (pcount - 1) - stream->pcount;
+        }
+        stream->pcount = pcount;
+    }
+    else if (stream->errors > 0)
+    {
+        stream->errors--;
+    }
+
+    iperf_jitter_update(&stream->jitter, time_us_32(), sec, usec);
+}
+
+static bool iperf_client_test(void)
+{
+    uint64_t start_us = 0;
+    uint64_t elapsed_us = 0;
+    int8_t state = 0;
+
+    // Same payload as iperf3 when it has no file to send : any bytes will do
+    memset(g_buf, 0xAA, g_buf_size);
+
+    iperf_stats_start(&g_stats);
+    start_us = g_stats.t0;
+
+    while (elapsed_us < (uint64_t)g_config.time * 1000000)
+    {
+        // The server only talks during a test to end it early
+        if (getSn_RX_RSR(SOCKET_CTRL) > 0)
+        {
+            recv(SOCKET_CTRL, (uint8_t *)&state, 1);
+            printf("[iperf] Test ended by the server, state %d\n", state);
+            iperf_stats_stop(&g_stats);
+            return false;
+        }
+
+        for (uint8_t i = 0; i < g_num_streams; i++)
+        {
+            if (g_config.reverse)
+            {
+                iperf_client_recv(&g_streams[i]);
+            }
+            else
+            {
+                iperf_client_send(&g_streams[i], elapsed_us);
+            }
+        }
+
+        iperf_stats_update(&g_stats, false);
+        elapsed_us = time_us_64() - start_us;
+    }
+
+    iperf_stats_update(&g_stats, true);
+    iperf_stats_stop(&g_stats);
+
+    return iperf_client_send_state(TEST_END);
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _IPERF_CLIENT_H_
+#define _IPERF_CLIENT_H_
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "wizchip_conf.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Streams, one socket each besides the control socket */
+#if (_WIZCHIP_ == W5100S)
+#define IPERF_CLIENT_MAX_STREAMS 3
+#else
+#define IPERF_CLIENT_MAX_STREAMS 4
+#endif
+
+/* Defaults */
+#define IPERF_CLIENT_TCP_BLKSIZE (1024 * 8)
+#define IPERF_CLIENT_UDP_BLKSIZE 1460
+#define IPERF_CLIENT_UDP_BANDWIDTH (1024 * 1024)
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Test to run, the options of the iperf3 client with the same meaning */
+typedef struct
+{
+    uint8_t server_ip[4]; // -c
+    uint16_t port;        // -p
+    bool udp;             // -u
+    bool reverse;         // -R
+    uint8_t parallel;     // -P, up to IPERF_CLIENT_MAX_STREAMS
+    uint16_t blksize;     // -l, 0 for IPERF_CLIENT_TCP_BLKSIZE or IPERF_CLIENT_UDP_BLKSIZE
+    uint32_t bandwidth;   // -b in bits/sec per stream, 0 for unlimited
+    uint16_t time;        // -t in seconds
+} iperf_client_config_t;
+
+/* Both sides' view of a test */
+typedef struct
+{
+    bool ok;                 // The test ran to IPERF_DONE
+    double seconds;          // Test duration on the device
+    uint64_t bytes;          // Bytes sent or received by the device
+    uint64_t packets;        // Writes or datagrams of the device
+    uint64_t server_bytes;   // Bytes sent or received by the server
+    uint64_t server_packets; // Datagrams counted by the server
+    uint64_t errors;         // Lost datagrams, counted by the receiving side
+    double jitter_ms;        // Jitter, measured by the receiving side
+} iperf_client_result_t;
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/*! \brief Initialize iperf3 client
+ *  \ingroup iperf_client
+ *
+ *  Also hands the cJSON allocations over to the iperf arena.
+ *
+ *  \param buf buffer used for the data of the test
+ *  \param size size of buf
+ */
+void iperf_client_initialize(uint8_t *buf, uint32_t size);
+
+/*! \brief Run one iperf3 test as the client
+ *  \ingroup iperf_client
+ *
+ *  Connect to an iperf3 server, exchange the parameters, run the test on the W5x00 sockets
+ *  and exchange the results. It returns when the test is over.
+ *  The control connection uses socket 1 and the streams sockets 0, 2, 3 and 4.
+ *
+ *  \param config test to run
+ *  \param result the results of the device and of the server
+ *  \return 0 if the test completed, -1 otherwise
+ */
+int8_t iperf_client_run(const iperf_client_config_t *config, iperf_client_result_t *result);
+
+#endif /* _IPERF_CLIENT_H_ */
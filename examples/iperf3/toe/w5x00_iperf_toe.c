@@ -19,8 +19,11 @@
 
 #include "socket.h"
 
-#include "cJSON.h" // JSON handling library
 #include "iperf.h"
+#include "iperf_json.h"
+#include "iperf_params.h"
+#include "iperf_client.h"
+#include "iperf_campaign.h"
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -34,13 +37,27 @@
 /* Buffer */
 #define ETHERNET_BUF_MAX_SIZE (1024 * 8)
 
-/* Socket */
-#define SOCKET_DATA 0
-#define SOCKET_CTRL 1
+/* Socket, the chip lays out the socket buffers in socket order, so the data socket comes after the control socket
+   and resizing it does not move the buffers of the open control connection */
+#define SOCKET_CTRL 0
+#define SOCKET_DATA 1
+
+/* Socket buffers, in KB per direction */
+#define BUF_CTRL_KB 2 // Parameters and results of the control connection
+#define BUF_ACK_KB 1  // Direction of the data socket that only carries ACKs or nothing
 
 /* Port */
 #define PORT_IPERF 5201
 
+/* Client mode, the device connects out to an iperf3 server instead of waiting for one */
+// #define IPERF_CLIENT
+#define IPERF_CLIENT_INTERVAL_MS (1000 * 10)
+
+/* Campaign, the result of every test is kept and the whole campaign is printed as one summary.
+   With IPERF_CLIENT the device runs g_campaign_config, otherwise it records IPERF_CAMPAIGN_SERVER_TESTS tests run by the clients */
+// #define IPERF_CAMPAIGN
+#define IPERF_CAMPAIGN_SERVER_TESTS 8
+
 #define MAX_RESULT_LEN 1024
 
 /* Cookie size */
@@ -81,6 +98,39 @@ static uint8_t cookie[COOKIE_SIZE] = {0};
 uint8_t dest_ip[4];
 uint16_t destport;
 
+#ifdef IPERF_CLIENT
+/* iperf client, same options as 'iperf3 -c 192.168.11.100 -t 10' */
+static iperf_client_config_t g_client_config =
+    {
+        .server_ip = {192, 168, 11, 100}, // -c
+        .port = PORT_IPERF,               // -p
+        .udp = false,                     // -u
+        .reverse = false,                 // -R
+        .parallel = 1,                    // -P
+        .blksize = 0,                     // -l, 0 for the default
+        .bandwidth = 0,                   // -b in bits/sec, 0 for unlimited, IPERF_CLIENT_UDP_BANDWIDTH for UDP
+        .time = 10,                       // -t
+};
+static iperf_client_result_t g_client_result;
+
+#ifdef IPERF_CAMPAIGN
+/* iperf campaign, TCP and UDP both ways with 1 and 2 streams, twice each */
+static iperf_campaign_config_t g_campaign_config =
+    {
+        .server_ip = {192, 168, 11, 100},
+        .port = PORT_IPERF,
+        .protocols = IPERF_CAMPAIGN_TCP | IPERF_CAMPAIGN_UDP,
+        .directions = IPERF_CAMPAIGN_FORWARD | IPERF_CAMPAIGN_REVERSE,
+        .blksizes = {0},                  // -l, default
+        .parallels = {1, 2},              // -P
+        .bandwidths = {0},                // -b, unlimited TCP and IPERF_CLIENT_UDP_BANDWIDTH UDP
+        .time = 10,                       // -t
+        .repeat = 2,
+        .pause_ms = 1000,
+};
+#endif
+#endif
+
 /**
  * ----------------------------------------------------------------------------------------------------
  * Functions
@@ -88,10 +138,17 @@ uint16_t destport;
  */
 /* Clock */
 static void set_clock_khz(void);
-void handle_param_exchange(bool *reverse, bool *udp);
+
+/* Buffer */
+static void initialize_buffers(void);
+static void set_stream_buffers(bool reverse);
+
+/* iperf */
+void handle_param_exchange(iperf_params_t *params);
 void handle_create_streams(bool udp, uint8_t *dest_ip, uint16_t destport);
 void start_iperf_test(Stats *stats, bool reverse, bool udp, uint8_t *dest_ip, uint16_t destport);
 void exchange_results(Stats *stats);
+static void send_ctrl(void *arg, const void *data, uint32_t len);
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -104,6 +161,7 @@ int main()
     uint8_t socket_status;
     Stats stats;
     
+    iperf_params_t params;
     bool reverse = false;
     bool udp = false;
 
@@ -123,6 +181,32 @@ int main()
     /* Get network information */
     print_network_information(g_net_info);
 
+#ifdef IPERF_CLIENT
+    if (g_client_config.udp && g_client_config.bandwidth == 0)
+    {
+        g_client_config.bandwidth = IPERF_CLIENT_UDP_BANDWIDTH;
+    }
+
+    iperf_client_initialize(g_iperf_buf, sizeof(g_iperf_buf));
+
+    while (1)
+    {
+#ifdef IPERF_CAMPAIGN
+        iperf_campaign_run(&g_campaign_config);
+#else
+        iperf_client_run(&g_client_config, &g_client_result);
+#endif
+
+        sleep_ms(IPERF_CLIENT_INTERVAL_MS);
+    }
+#endif
+
+#ifdef IPERF_CAMPAIGN
+    iperf_campaign_initialize();
+#endif
+
+    initialize_buffers();
+
     socket(SOCKET_CTRL, Sn_MR_TCP, PORT_IPERF, 0);
     listen(SOCKET_CTRL);
 
@@ -134,7 +218,10 @@ int main()
 
         if (socket_status == SOCK_ESTABLISHED)
         {
-            handle_param_exchange(&reverse, &udp);
+            handle_param_exchange(&params);
+            reverse = params.reverse;
+            udp = params.udp;
+            set_stream_buffers(reverse);
             handle_create_streams(udp, dest_ip, destport);
 
             if (reverse)
@@ -143,6 +230,14 @@ int main()
             }
             
             start_iperf_test(&stats, reverse, udp, dest_ip, PORT_IPERF);
+
+#ifdef IPERF_CAMPAIGN
+            if (iperf_campaign_record(&params, &stats, stats.nb0 > 0) >= IPERF_CAMPAIGN_SERVER_TESTS)
+            {
+                iperf_campaign_summary();
+                iperf_campaign_initialize();
+            }
+#endif
         } 
         else if (socket_status == SOCK_CLOSE_WAIT)
         {
@@ -178,16 +273,47 @@ static void set_clock_khz(void)
     );
 }
 
-void handle_param_exchange(bool *reverse, bool *udp) 
+/* Buffer */
+static void initialize_buffers(void)
 {
-    char buffer[512] = {0};
+    // Only the control and data sockets are used, the control socket keeps its size while it is open
+    for (uint8_t sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+    {
+        close(sn);
+        setSn_RXBUF_SIZE(sn, (sn == SOCKET_CTRL) ? BUF_CTRL_KB : 0);
+        setSn_TXBUF_SIZE(sn, (sn == SOCKET_CTRL) ? BUF_CTRL_KB : 0);
+    }
+
+    set_stream_buffers(false);
+}
+
+/* The data socket gets the rest of the memory in the direction of the test, its size can only be changed while it is closed */
+static void set_stream_buffers(bool reverse)
+{
+    // Sizes are powers of 2 and the control socket keeps its share, so one stream gets at most half of the memory
+    uint8_t kb = wizchip_buf_kb(WIZCHIP_BUF_TOTAL_KB - BUF_CTRL_KB, 1);
+
+    close(SOCKET_DATA);
+    setSn_RXBUF_SIZE(SOCKET_DATA, reverse ? BUF_ACK_KB : kb);
+    setSn_TXBUF_SIZE(SOCKET_DATA, reverse ? kb : BUF_ACK_KB);
+
+#ifdef IPERF_DEBUG
+    printf("[iperf] Data socket buffers : RX %d KB, TX %d KB\n", getSn_RxMAX(SOCKET_DATA) / 1024, getSn_TxMAX(SOCKET_DATA) / 1024);
+#endif
+}
+
+void handle_param_exchange(iperf_params_t *params) 
+{
+    char buffer[128];
     uint8_t cmd;
-    uint16_t len = 0;
+    uint32_t len = 0;
     uint8_t raw_len[4] = {0};
     int cookie_len;
-    cJSON *json;
-    cJSON *reverseItem;
-    cJSON *udpItem;
+    int32_t received;
+    iperf_params_parser_t parser;
+
+    // A failed exchange leaves the default test, not the previous one
+    memset(params, 0, sizeof(iperf_params_t));
 
     cookie_len = recv(SOCKET_CTRL, cookie, COOKIE_SIZE);
     if (cookie_len != COOKIE_SIZE)
@@ -204,37 +330,48 @@ void handle_param_exchange(bool *reverse, bool *udp)
     send(SOCKET_CTRL, &cmd, 1);
     recv(SOCKET_CTRL, raw_len, 4);
 
-    len = (raw_len[0] << 24) | (raw_len[1] << 16) | (raw_len[2] << 8) | raw_len[3];
+    len = ((uint32_t)raw_len[0] << 24) | ((uint32_t)raw_len[1] << 16) | ((uint32_t)raw_len[2] << 8) | raw_len[3];
 #ifdef IPERF_DEBUG
-    printf("[iperf] Raw length bytes: 0x%02X 0x%02X 0x%02X 0x%02X, Parsed length: %d\n", raw_len[0], raw_len[1], raw_len[2], raw_len[3], len);
+    printf("[iperf] Raw length bytes: 0x%02X 0x%02X 0x%02X 0x%02X, Parsed length: %u\n", raw_len[0], raw_len[1], raw_len[2], raw_len[3], len);
 #endif
 
-    recv(SOCKET_CTRL, (uint8_t *)buffer, len);
-    buffer[len] = '\0'; // Null-terminate
+    if (len > IPERF_PARAMS_MAX_SIZE)
+    {
+        printf("[iperf] Parameter length %u exceeds the iperf3 maximum.\n", len);
+        return;
+    }
 
+    // Parsed in pieces as they are received, the message is never held whole
+    iperf_params_init(&parser, params);
 #ifdef IPERF_DEBUG
-    printf("[iperf] Received parameters: %s\n", buffer);
+    printf("[iperf] Received parameters: ");
 #endif
-
-    json = cJSON_Parse(buffer);
-    if (json == NULL)
+    while (len > 0)
     {
-        printf("[iperf] Failed to parse JSON: %s\n", cJSON_GetErrorPtr());
+        received = recv(SOCKET_CTRL, (uint8_t *)buffer, len < sizeof(buffer) ? len : sizeof(buffer));
+        if (received <= 0)
+        {
+            break;
+        }
+#ifdef IPERF_DEBUG
+        printf("%.*s", (int)received, buffer);
+#endif
+        iperf_params_feed(&parser, buffer, received);
+        len -= received;
     }
-    else
-    {
-        reverseItem = cJSON_GetObjectItem(json, "reverse");
-        udpItem = cJSON_GetObjectItem(json, "udp");
+#ifdef IPERF_DEBUG
+    printf("\n");
+#endif
 
-        *reverse = (reverseItem && cJSON_IsBool(reverseItem)) ? reverseItem->valueint : 0;
-        *udp = (udpItem && cJSON_IsBool(udpItem)) ? udpItem->valueint : 0;
+    if (len > 0 || !iperf_params_finish(&parser))
+    {
+        printf("[iperf] Failed to parse JSON parameters\n");
+        return;
+    }
 
 #ifdef IPERF_DEBUG
-        printf("[iperf] Parsed JSON: %s\n", cJSON_Print(json));
-        printf("[iperf] Parsed JSON: reverse=%d, udp=%d\n", *reverse, *udp);
+    printf("[iperf] Parsed JSON: reverse=%d, udp=%d, parallel=%u, len=%u, time=%u\n", params->reverse, params->udp, params->parallel, params->len, params->time);
 #endif
-        cJSON_Delete(json);
-    }
 }
 
 void handle_create_streams(bool udp, uint8_t *dest_ip, uint16_t destport)
@@ -288,6 +425,9 @@ void start_iperf_test(Stats *stats, bool reverse, bool udp, uint8_t *dest_ip, ui
     uint32_t pack_len = 0;
     uint16_t sent_bytes = 0;
     uint16_t recv_bytes = 0;
+#ifdef USE_DMA_CRC
+    uint32_t payload_crc = 0;
+#endif
 
     // Start test
     cmd = TEST_START;
@@ -335,7 +475,13 @@ void start_iperf_test(Stats *stats, bool reverse, bool udp, uint8_t *dest_ip, ui
                 }
                 else
                 {
+#ifdef USE_DMA_CRC
+                    wizchip_crc32_rx_start(payload_crc);
+#endif
                     recv_bytes = recv_iperf(SOCKET_DATA, (uint8_t *)g_iperf_buf, pack_len);
+#ifdef USE_DMA_CRC
+                    payload_crc = wizchip_crc32_rx_stop(g_iperf_buf, recv_bytes);
+#endif
                 }
 
                 iperf_stats_add_bytes(stats, recv_bytes);
@@ -354,6 +500,13 @@ void start_iperf_test(Stats *stats, bool reverse, bool udp, uint8_t *dest_ip, ui
     }
     iperf_stats_stop(stats);
 
+#ifdef USE_DMA_CRC
+    if (!reverse && !udp)
+    {
+        printf("Payload CRC-32: 0x%08X\n", payload_crc);
+    }
+#endif
+
     exchange_results(stats);
 }
 
@@ -361,13 +514,14 @@ void exchange_results(Stats *stats)
 {
     uint8_t cmd = EXCHANGE_RESULTS;
     uint32_t result_len = 0;
-    uint8_t length_bytes[4];
     char buffer[1024];
-    char *results_str;
-    uint32_t results_len;
-    cJSON *results;
-    cJSON *streams;
-    cJSON *stream;
+    iperf_json_stream_t stream = {
+        .id = 1,
+        .bytes = stats->nb0,
+        .retransmits = 0,
+        .packets = stats->np0,
+        .end_us = stats->t3 - stats->t0,
+    };
 
     // Ask to exchange results
     send(SOCKET_CTRL, &cmd, 1);
@@ -376,7 +530,7 @@ void exchange_results(Stats *stats)
     recv(SOCKET_CTRL, (uint8_t *)&result_len, 4);
     result_len = (result_len << 24) | ((result_len << 8) & 0x00FF0000) | ((result_len >> 8) & 0x0000FF00) | (result_len >> 24); // Convert to host-endian
 
-    if (result_len > sizeof(buffer))
+    if (result_len >= sizeof(buffer))
     {
         printf("[iperf] Received result length exceeds buffer size.\n");
         return;
@@ -388,41 +542,8 @@ void exchange_results(Stats *stats)
     printf("[iperf] Client results received: %s\n", buffer);
 #endif
 
-    // Prepare server results
-    results = cJSON_CreateObject();
-    cJSON_AddNumberToObject(results, "cpu_util_total", 0);
-    cJSON_AddNumberToObject(results, "cpu_util_user", 0);
-    cJSON_AddNumberToObject(results, "cpu_util_system", 0);
-    cJSON_AddNumberToObject(results, "sender_has_retransmits", 0);
-
-    // Streams object
-    streams = cJSON_CreateArray();
-    stream = cJSON_CreateObject();
-    cJSON_AddNumberToObject(stream, "id", 1);
-    cJSON_AddNumberToObject(stream, "bytes", stats->nb0);
-    cJSON_AddNumberToObject(stream, "retransmits", 0);
-    cJSON_AddNumberToObject(stream, "jitter", 0);
-    cJSON_AddNumberToObject(stream, "errors", 0);
-    cJSON_AddNumberToObject(stream, "packets", stats->np0);
-    cJSON_AddNumberToObject(stream, "start_time", 0);
-    cJSON_AddNumberToObject(stream, "end_time", (double)(stats->t3 - stats->t0) / 1000000.0);
-    cJSON_AddItemToArray(streams, stream);
-    cJSON_AddItemToObject(results, "streams", streams);
-
-    // Serialize JSON to string
-    results_str = cJSON_PrintUnformatted(results);
-    results_len = strlen(results_str);
-
-    // Send server results
-    length_bytes[0] = (results_len >> 24) & 0xFF;
-    length_bytes[1] = (results_len >> 16) & 0xFF;
-    length_bytes[2] = (results_len >> 8) & 0xFF;
-    length_bytes[3] = results_len & 0xFF;
-
-    send(SOCKET_CTRL, length_bytes, 4);
-    send(SOCKET_CTRL, (uint8_t *)results_str, results_len);
-
-    cJSON_Delete(results);
+    // Send server results, written straight to the control socket
+    iperf_json_send_results(&stream, 1, 0, send_ctrl, NULL);
 
     // Ask to display results
     cmd = DISPLAY_RESULTS;
@@ -438,4 +559,10 @@ void exchange_results(Stats *stats)
     {
         printf("[iperf] Unexpected command received: %d\n", cmd);
     }
-}
\ No newline at end of file
+}
+static void send_ctrl(void *arg, const void *data, uint32_t len)
+{
+    (void)arg;
+
+    send(SOCKET_CTRL, (uint8_t *)data, len);
+}
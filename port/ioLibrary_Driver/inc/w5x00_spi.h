@@ -7,6 +7,8 @@
 #ifndef _W5X00_SPI_H_
 #define _W5X00_SPI_H_
 
+#include <stdbool.h>
+
 #include "board_list.h"
 
 /**
@@ -40,6 +42,16 @@
 /* Use SPI DMA */
 #define USE_SPI_DMA // if you want to use SPI DMA, uncomment.
 #endif
+
+/* Use DMA sniffer CRC-32 */
+//#define USE_DMA_CRC // if you want to check data integrity with the DMA sniffer, uncomment.
+
+/* Socket buffer memory of the chip, in KB per direction */
+#if (_WIZCHIP_ == W5100S)
+#define WIZCHIP_BUF_TOTAL_KB 8
+#else
+#define WIZCHIP_BUF_TOTAL_KB 16
+#endif
 /**
  * ----------------------------------------------------------------------------------------------------
  * Functions
@@ -198,6 +210,86 @@ void network_initialize(wiz_NetInfo net_info);
  */
 void print_network_information(wiz_NetInfo net_info);
 
+/* Buffer */
+/*! \brief Socket buffer size for a share of the memory
+ *  \ingroup w5x00_spi
+ *
+ *  Return the largest socket buffer size the chip accepts, a power of 2 up to 16 KB,
+ *  that count sockets can each take out of total_kb. It is at least 1 KB.
+ *
+ *  \param total_kb memory to share, in KB
+ *  \param count number of sockets sharing it
+ *  \return the buffer size in KB, for setSn_RXBUF_SIZE() and setSn_TXBUF_SIZE()
+ */
+uint8_t wizchip_buf_kb(uint8_t total_kb, uint8_t count);
+
 int32_t recv_iperf(uint8_t sn, uint8_t * buf, uint16_t len);
 
+/*! \brief Send data without waiting for the previous send
+ *  \ingroup w5x00_spi
+ *
+ *  Write data to the socket TX buffer and issue SEND if the previous SEND has completed.
+ *  Otherwise the data is sent with the next call, so writing the next data overlaps the transmission
+ *  instead of waiting for SEND_OK as send() does. The caller checks getSn_TX_FSR() first.
+ *  A socket must not be used with send() or sendto() and send_iperf() at the same time.
+ *  On a UDP socket each call is one datagram, to the destination set with setSn_DIPR() and setSn_DPORT().
+ *  It waits for the SEND of the previous datagram before writing, so only TCP data is written ahead.
+ *
+ *  \param sn socket number
+ *  \param buf data to send
+ *  \param len size of data, up to getSn_TX_FSR()
+ *  \return len
+ */
+int32_t send_iperf(uint8_t sn, uint8_t *buf, uint16_t len);
+
+/*! \brief Push out the data written by send_iperf
+ *  \ingroup w5x00_spi
+ *
+ *  Issue SEND for the data left by send_iperf when the previous SEND has completed.
+ *  It must be called until it returns true before the socket is disconnected.
+ *
+ *  \param sn socket number
+ *  \return true if all data has been sent or the connection is gone, false otherwise
+ */
+bool send_iperf_flush(uint8_t sn);
+
+#ifdef USE_DMA_CRC
+/* CRC */
+/*! \brief Calculate CRC-32 with the DMA sniffer
+ *  \ingroup w5x00_spi
+ *
+ *  Run a memory DMA transfer over the buffer and return the CRC-32 (IEEE 802.3)
+ *  computed by the DMA sniffer. The CPU only programs the transfer.
+ *  Pass the previous result as crc to continue a checksum over several buffers, or 0 to start.
+ *
+ *  \param crc previous CRC-32 value
+ *  \param buf a pointer to the data
+ *  \param len the length of the data
+ *  \return the CRC-32 value
+ */
+uint32_t wizchip_crc32(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+/*! \brief Start CRC-32 on received data
+ *  \ingroup w5x00_spi
+ *
+ *  Attach the DMA sniffer to the SPI RX DMA channel, so that every burst read from the
+ *  WIZchip is included in the CRC-32 as it is transferred.
+ *
+ *  \param crc previous CRC-32 value, or 0 to start
+ */
+void wizchip_crc32_rx_start(uint32_t crc);
+
+/*! \brief Stop CRC-32 on received data
+ *  \ingroup w5x00_spi
+ *
+ *  Detach the DMA sniffer from the SPI RX DMA channel and return the CRC-32.
+ *  If SPI DMA is not used, the CRC-32 of buf is calculated with wizchip_crc32() instead.
+ *
+ *  \param buf a pointer to the data received since wizchip_crc32_rx_start()
+ *  \param len the length of the data
+ *  \return the CRC-32 value
+ */
+uint32_t wizchip_crc32_rx_stop(const uint8_t *buf, uint32_t len);
+#endif
+
 #endif /* _W5X00_SPI_H_ */
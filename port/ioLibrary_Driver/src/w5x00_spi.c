@@ -34,6 +34,10 @@
  */
 static critical_section_t g_wizchip_cri_sec;
 
+/* Pipelined send, per socket bit : a SEND command is in progress, data was written since the last SEND */
+static uint8_t g_send_busy = 0;
+static uint8_t g_send_pending = 0;
+
 #ifdef USE_SPI_DMA
 static uint dma_tx;
 static uint dma_rx;
@@ -41,6 +45,13 @@ static dma_channel_config dma_channel_config_tx;
 static dma_channel_config dma_channel_config_rx;
 #endif
 
+#ifdef USE_DMA_CRC
+static uint dma_crc;
+static uint8_t dma_crc_sink;
+static uint32_t dma_crc_rx_seed;
+static bool dma_crc_rx_enabled = false;
+#endif
+
 
 #ifdef USE_SPI_PIO
 wiznet_spi_config_t g_spi_config = {
@@ -124,6 +135,9 @@ static void wizchip_read_burst(uint8_t *pBuf, uint16_t len)
 
     channel_config_set_read_increment(&dma_channel_config_rx, false);
     channel_config_set_write_increment(&dma_channel_config_rx, true);
+#ifdef USE_DMA_CRC
+    channel_config_set_sniff_enable(&dma_channel_config_rx, dma_crc_rx_enabled);
+#endif
     dma_channel_configure(dma_rx, &dma_channel_config_rx,
                           pBuf,                      // write address
                           &spi_get_hw(SPI_PORT)->dr, // read address
@@ -148,6 +162,9 @@ static void wizchip_write_burst(uint8_t *pBuf, uint16_t len)
 
     channel_config_set_read_increment(&dma_channel_config_rx, false);
     channel_config_set_write_increment(&dma_channel_config_rx, false);
+#ifdef USE_DMA_CRC
+    channel_config_set_sniff_enable(&dma_channel_config_rx, false);
+#endif
     dma_channel_configure(dma_rx, &dma_channel_config_rx,
                           &dummy_data,               // write address
                           &spi_get_hw(SPI_PORT)->dr, // read address
@@ -213,6 +230,10 @@ void wizchip_spi_initialize(void)
     channel_config_set_write_increment(&dma_channel_config_rx, true);
 #endif
 #endif
+
+#ifdef USE_DMA_CRC
+    dma_crc = dma_claim_unused_channel(true);
+#endif
 }
 
 void wizchip_cris_initialize(void)
@@ -329,6 +350,19 @@ void print_network_information(wiz_NetInfo net_info)
     printf("====================================================================================================\n\n");
 }
 
+/* Buffer */
+uint8_t wizchip_buf_kb(uint8_t total_kb, uint8_t count)
+{
+    uint8_t kb = 1;
+
+    while (count > 0 && kb * 2 * count <= total_kb && kb * 2 <= 16)
+    {
+        kb *= 2;
+    }
+
+    return kb;
+}
+
 int32_t recv_iperf(uint8_t sn, uint8_t * buf, uint16_t len)
 {
    wiz_recv_data(sn, buf, len);
@@ -336,4 +370,165 @@ int32_t recv_iperf(uint8_t sn, uint8_t * buf, uint16_t len)
    while(getSn_CR(sn));
  
    return (int32_t)len;
-}
\ No newline at end of file
+}
+
+/* Whether the last SEND of the socket has completed */
+static bool send_iperf_idle(uint8_t sn)
+{
+    uint8_t ir = 0;
+
+    if (!(g_send_busy & (1 << sn)))
+    {
+        return true;
+    }
+
+    ir = getSn_IR(sn);
+
+    // The connection or the ARP request timed out, nothing written will be sent
+    if ((ir & Sn_IR_TIMEOUT) || getSn_SR(sn) == SOCK_CLOSED)
+    {
+        setSn_IR(sn, Sn_IR_TIMEOUT);
+        g_send_busy &= ~(1 << sn);
+        g_send_pending &= ~(1 << sn);
+        return true;
+    }
+
+    if (!(ir & Sn_IR_SENDOK))
+    {
+        return false;
+    }
+
+    setSn_IR(sn, Sn_IR_SENDOK);
+    g_send_busy &= ~(1 << sn);
+
+    return true;
+}
+
+int32_t send_iperf(uint8_t sn, uint8_t *buf, uint16_t len)
+{
+    // A UDP SEND makes one datagram of all the data written, so a datagram is only written once the previous SEND has completed
+    if ((getSn_MR(sn) & 0x0F) == Sn_MR_UDP)
+    {
+        while (!send_iperf_idle(sn))
+            ;
+    }
+
+    if (len > 0)
+    {
+        wiz_send_data(sn, buf, len);
+        g_send_pending |= (1 << sn);
+    }
+
+    send_iperf_flush(sn);
+
+    return (int32_t)len;
+}
+
+bool send_iperf_flush(uint8_t sn)
+{
+    if (!send_iperf_idle(sn))
+    {
+        return false;
+    }
+
+    if (g_send_pending & (1 << sn))
+    {
+        // A TCP SEND covers everything written up to Sn_TX_WR, so the data written meanwhile goes out at once
+        setSn_IR(sn, Sn_IR_SENDOK);
+        setSn_CR(sn, Sn_CR_SEND);
+        while (getSn_CR(sn))
+            ;
+
+        g_send_pending &= ~(1 << sn);
+        g_send_busy |= (1 << sn);
+        return false;
+    }
+
+    return true;
+}
+
+#ifdef USE_DMA_CRC
+/* CRC */
+static uint32_t dma_crc_seed(uint32_t crc)
+{
+    uint32_t seed = 0;
+
+    // The sniffer shifts MSB first and reverses its output, so the seed is the bit reversed CRC register
+    crc = ~crc;
+    for (int bit = 0; bit < 32; bit++)
+    {
+        seed = (seed << 1) | (crc & 1);
+        crc >>= 1;
+    }
+
+    return seed;
+}
+
+static void dma_crc_sniffer_enable(uint channel, uint32_t crc)
+{
+    dma_sniffer_enable(channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    dma_sniffer_set_output_reverse_enabled(true);
+    dma_sniffer_set_output_invert_enabled(true);
+    dma_sniffer_set_data_accumulator(dma_crc_seed(crc));
+}
+
+uint32_t wizchip_crc32(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    uint32_t sniff_ctrl;
+    uint32_t sniff_data;
+    dma_channel_config config;
+
+    if (len == 0)
+    {
+        return crc;
+    }
+
+    // Save the raw sniffer state, it may be accumulating SPI RX data
+    sniff_ctrl = dma_hw->sniff_ctrl;
+    hw_clear_bits(&dma_hw->sniff_ctrl, DMA_SNIFF_CTRL_OUT_REV_BITS | DMA_SNIFF_CTRL_OUT_INV_BITS);
+    sniff_data = dma_hw->sniff_data;
+
+    config = dma_channel_get_default_config(dma_crc);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_sniff_enable(&config, true);
+
+    dma_crc_sniffer_enable(dma_crc, crc);
+
+    dma_channel_configure(dma_crc, &config,
+                          &dma_crc_sink, // write address
+                          buf,           // read address
+                          len,           // element count (each element is of size transfer_data_size)
+                          true);         // start now
+    dma_channel_wait_for_finish_blocking(dma_crc);
+
+    crc = dma_sniffer_get_data_accumulator();
+
+    dma_hw->sniff_data = sniff_data;
+    dma_hw->sniff_ctrl = sniff_ctrl;
+
+    return crc;
+}
+
+void wizchip_crc32_rx_start(uint32_t crc)
+{
+#ifdef USE_SPI_DMA
+    dma_crc_sniffer_enable(dma_rx, crc);
+    dma_crc_rx_enabled = true;
+#else
+    dma_crc_rx_seed = crc;
+#endif
+}
+
+uint32_t wizchip_crc32_rx_stop(const uint8_t *buf, uint32_t len)
+{
+#ifdef USE_SPI_DMA
+    dma_crc_rx_enabled = false;
+
+    return dma_sniffer_get_data_accumulator();
+#else
+    return wizchip_crc32(dma_crc_rx_seed, buf, len);
+#endif
+}
+#endif
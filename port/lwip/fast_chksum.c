@@ -0,0 +1,237 @@
+/**
+ * Copyright (c) 2022 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "fast_chksum.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Checksum */
+#define FOLD_U32(s) (((s) >> 16) + ((s) & 0x0000FFFFUL))
+#define SWAP_BYTES_IN_WORD(w) ((((w) & 0xFF) << 8) | (((w) & 0xFF00) >> 8))
+
+/* Words summed per step of the add-with-carry chain */
+#if defined(__ARM_ARCH_8M_MAIN__)
+#define CHKSUM_BLOCK_WORDS 8
+#else
+#define CHKSUM_BLOCK_WORDS 4
+#endif
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Add one block of words to a 32-bit one's complement sum, optionally storing them to dst */
+static inline __attribute__((always_inline)) uint32_t chksum_block(uint32_t sum, const uint32_t *src, uint32_t *dst, bool copy)
+{
+#if defined(__ARM_ARCH_8M_MAIN__)
+    uint32_t a = src[0], b = src[1], c = src[2], d = src[3];
+    uint32_t e = src[4], f = src[5], g = src[6], h = src[7];
+
+    if (copy)
+    {
+        dst[0] = a, dst[1] = b, dst[2] = c, dst[3] = d;
+        dst[4] = e, dst[5] = f, dst[6] = g, dst[7] = h;
+    }
+
+    // Cortex-M33 : one ADCS per word, the final carry is added back with an immediate
+    __asm__(
+        "adds %[s], %[s], %[a]\n"
+        "adcs %[s], %[s], %[b]\n"
+        "adcs %[s], %[s], %[c]\n"
+        "adcs %[s], %[s], %[d]\n"
+        "adcs %[s], %[s], %[e]\n"
+        "adcs %[s], %[s], %[f]\n"
+        "adcs %[s], %[s], %[g]\n"
+        "adcs %[s], %[s], %[h]\n"
+        "adc %[s], %[s], #0\n"
+        : [s] "+r"(sum)
+        : [a] "r"(a), [b] "r"(b), [c] "r"(c), [d] "r"(d), [e] "r"(e), [f] "r"(f), [g] "r"(g), [h] "r"(h)
+        : "cc");
+
+    return sum;
+#elif defined(__ARM_ARCH_6M__)
+    uint32_t a = src[0], b = src[1], c = src[2], d = src[3];
+
+    if (copy)
+    {
+        dst[0] = a, dst[1] = b, dst[2] = c, dst[3] = d;
+    }
+
+    // Cortex-M0+ : ADCS only takes registers, so a is reused as the zero for the final carry (MOVS keeps C)
+    __asm__(
+        ".syntax unified\n"
+        "adds %[s], %[a]\n"
+        "adcs %[s], %[b]\n"
+        "adcs %[s], %[c]\n"
+        "adcs %[s], %[d]\n"
+        "movs %[a], #0\n"
+        "adcs %[s], %[a]\n"
+        : [s] "+l"(sum), [a] "+l"(a)
+        : [b] "l"(b), [c] "l"(c), [d] "l"(d)
+        : "cc");
+
+    return sum;
+#else
+    uint64_t acc = sum;
+
+    for (int i = 0; i < CHKSUM_BLOCK_WORDS; i++)
+    {
+        if (copy)
+        {
+            dst[i] = src[i];
+        }
+        acc += src[i];
+    }
+
+    acc = (acc & 0xFFFFFFFFULL) + (acc >> 32);
+    acc = (acc & 0xFFFFFFFFULL) + (acc >> 32);
+
+    return (uint32_t)acc;
+#endif
+}
+
+/* Same steps as lwip_standard_chksum() (algorithm 3), with the 32-bit loop replaced by chksum_block() */
+static inline __attribute__((always_inline)) uint16_t chksum(void *dst, const void *src, int len, bool copy)
+{
+    const uint8_t *pb = (const uint8_t *)src;
+    uint8_t *db = (uint8_t *)dst;
+    const uint32_t *pl;
+    uint32_t *dl;
+    uint32_t sum = 0;
+    uint32_t w = 0;
+    uint16_t t = 0;
+    int odd = ((uintptr_t)pb & 1);
+
+    if (odd && len > 0)
+    {
+        ((uint8_t *)&t)[1] = *pb;
+        if (copy)
+        {
+            *db++ = *pb;
+        }
+        pb++;
+        len--;
+    }
+
+    if (((uintptr_t)pb & 3) && len > 1)
+    {
+        w = *(const uint16_t *)(const void *)pb;
+        if (copy)
+        {
+            *(uint16_t *)(void *)db = (uint16_t)w;
+            db += 2;
+        }
+        sum += w;
+        pb += 2;
+        len -= 2;
+    }
+
+    pl = (const uint32_t *)(const void *)pb;
+    dl = (uint32_t *)(void *)db;
+
+    while (len >= CHKSUM_BLOCK_WORDS * 4)
+    {
+        sum = chksum_block(sum, pl, dl, copy);
+        pl += CHKSUM_BLOCK_WORDS;
+        if (copy)
+        {
+            dl += CHKSUM_BLOCK_WORDS;
+        }
+        len -= CHKSUM_BLOCK_WORDS * 4;
+    }
+
+    while (len > 3)
+    {
+        w = *pl++;
+        if (copy)
+        {
+            *dl++ = w;
+        }
+        sum += w;
+        if (sum < w)
+        {
+            sum++; // add back carry
+        }
+        len -= 4;
+    }
+
+    // make room in upper bits
+    sum = FOLD_U32(sum);
+
+    pb = (const uint8_t *)pl;
+    db = (uint8_t *)dl;
+
+    // 16-bit aligned word remaining?
+    if (len > 1)
+    {
+        w = *(const uint16_t *)(const void *)pb;
+        if (copy)
+        {
+            *(uint16_t *)(void *)db = (uint16_t)w;
+            db += 2;
+        }
+        sum += w;
+        pb += 2;
+        len -= 2;
+    }
+
+    // dangling tail byte remaining?
+    if (len > 0)
+    {
+        ((uint8_t *)&t)[0] = *pb;
+        if (copy)
+        {
+            *db = *pb;
+        }
+    }
+
+    sum += t;
+
+    sum = FOLD_U32(sum);
+    sum = FOLD_U32(sum);
+
+    if (odd)
+    {
+        sum = SWAP_BYTES_IN_WORD(sum);
+    }
+
+    return (uint16_t)sum;
+}
+
+uint16_t fast_chksum(const void *dataptr, int len)
+{
+    return chksum(NULL, dataptr, len, false);
+}
+
+uint16_t fast_chksum_copy(void *dst, const void *src, uint16_t len)
+{
+    // Words can only be copied and summed together if both buffers have the same alignment
+    if ((((uintptr_t)dst ^ (uintptr_t)src) & 3) != 0)
+    {
+        memcpy(dst, src, len);
+        return chksum(NULL, dst, len, false);
+    }
+
+    return chksum(dst, src, len, true);
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2022 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _FAST_CHKSUM_H_
+#define _FAST_CHKSUM_H_
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdint.h>
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+/*! \brief Internet checksum
+ *  \ingroup fast_chksum
+ *
+ *  Drop-in replacement for lwip_standard_chksum(), plugged in with LWIP_CHKSUM.
+ *  It returns the same value: the folded one's complement sum, not inverted, of 16-bit words
+ *  read in host byte order. The bulk of the data is summed one 32-bit word at a time with an
+ *  add-with-carry chain, 4 words per step on Cortex-M0+ and 8 words per step on Cortex-M33.
+ *
+ *  \param dataptr a pointer to the data, any alignment
+ *  \param len the length of the data in bytes
+ *  \return the checksum
+ */
+uint16_t fast_chksum(const void *dataptr, int len);
+
+/*! \brief Copy and checksum
+ *  \ingroup fast_chksum
+ *
+ *  Used as LWIP_CHKSUM_COPY when LWIP_CHECKSUM_ON_COPY is enabled.
+ *  It copies len bytes from src to dst and returns fast_chksum(dst, len).
+ *  If src and dst have the same alignment, each word is summed while it is copied, so the data is read once.
+ *
+ *  \param dst destination
+ *  \param src source
+ *  \param len the length of the data in bytes
+ *  \return the checksum of the copied data
+ */
+uint16_t fast_chksum_copy(void *dst, const void *src, uint16_t len);
+
+#endif /* _FAST_CHKSUM_H_ */
@@ -32,6 +32,55 @@
 #ifndef __LWIPOPTS_H__
 #define __LWIPOPTS_H__
 
+/* Profiles */
+#define LWIP_PROFILE_LOW_RAM 0
+#define LWIP_PROFILE_BALANCED 1
+#define LWIP_PROFILE_MAX_THROUGHPUT 2
+
+/* The profile is selected with the LWIP_PROFILE option in CMakeLists.txt */
+#ifndef LWIP_PROFILE
+#define LWIP_PROFILE LWIP_PROFILE_BALANCED
+#endif
+
+/* Set with the LWIP_DUAL_CORE option in CMakeLists.txt : MACRAW I/O on core 0, lwIP on core 1 */
+#ifndef LWIP_DUAL_CORE
+#define LWIP_DUAL_CORE 0
+#endif
+
+#if LWIP_DUAL_CORE
+/* pbufs are allocated on core 0 and freed on core 1, so protected sections must lock out the other core too */
+#define SYS_LIGHTWEIGHT_PROT 1
+#define SYS_ARCH_DECL_PROTECT(lev) uint32_t lev
+#define SYS_ARCH_PROTECT(lev) lev = netif_arch_protect()
+#define SYS_ARCH_UNPROTECT(lev) netif_arch_unprotect(lev)
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+uint32_t netif_arch_protect(void);
+void netif_arch_unprotect(uint32_t save);
+#endif
+#endif
+
+/* Internet checksum in fast_chksum.c, unrolled for Cortex-M0+ and Cortex-M33 */
+#define LWIP_CHKSUM fast_chksum
+
+/* Set to 0 to copy data in tcp_write() with memcpy and checksum it later, instead of computing the checksum during the copy */
+#ifndef LWIP_CHECKSUM_ON_COPY
+#define LWIP_CHECKSUM_ON_COPY 1
+#endif
+
+#if LWIP_CHECKSUM_ON_COPY
+#define LWIP_CHKSUM_COPY(dst, src, len) fast_chksum_copy(dst, src, len)
+#endif
+
+#ifndef __ASSEMBLER__
+#include "fast_chksum.h"
+#endif
+
+/* The pool level is read from the memp statistics for the early drop in the MACRAW receive path */
+#define LWIP_STATS 1
+#define MEMP_STATS 1
+
 /* Prevent having to link sys_arch.c (we don't test the API layers in unit tests) */
 #define NO_SYS 1
 #define MEM_ALIGNMENT 4
@@ -43,7 +92,6 @@
 #define LWIP_ICMP 1
 #define LWIP_UDP 1
 #define LWIP_TCP 1
-#define MEM_SIZE 2048
 
 // disable ACD to avoid build errors
 // http://lwip.100.n7.nabble.com/Build-issue-if-LWIP-DHCP-is-set-to-0-td33280.html
@@ -56,8 +104,81 @@
 #define LWIP_NETIF_STATUS_CALLBACK 1
 
 #define TCP_MSS (1500 /*mtu*/ - 20 /*iphdr*/ - 20 /*tcphhr*/)
+
+/* Number of full size frames the MACRAW socket RX buffer (8 KB on the W5500) can hold, i.e. the longest burst drained at once */
+#define MACRAW_RX_BUF_SIZE (8 * 1024)
+#define MACRAW_RX_BURST_DEPTH (MACRAW_RX_BUF_SIZE / (TCP_MSS + 54 + 2))
+
+/* TCP payload of a full pool pbuf, PBUF_POOL_BUFSIZE less the headers the lwIP sanity check of TCP_WND counts */
+#define PBUF_POOL_TCP_PAYLOAD (PBUF_POOL_BUFSIZE - 54)
+
+/* Set to 1 to read all pending MACRAW frames in one SPI burst into a RAM buffer and copy them into pbufs,
+ * instead of reading each frame straight into its pbuf. It costs MACRAW_RX_BUF_SIZE bytes of RAM and one copy,
+ * and saves two SPI transactions and one RECV command per frame, which matters most for small frames. */
+#ifndef MACRAW_RX_BATCH
+#define MACRAW_RX_BATCH 0
+#endif
+
+/* Maximum number of frames handed over per recv_lwip_batch() call */
+#define MACRAW_RX_BATCH_FRAMES 8
+
+/* Early drop : when few pool pbufs are left, received frames are classified and the least important are dropped
+ * in the socket buffer. Only ARP and TCP segments without payload (ACK, SYN, FIN, RST) may use the last
+ * MACRAW_RX_RESERVE_CONTROL pbufs, and other traffic than the test flow is dropped below MACRAW_RX_RESERVE_FLOW. */
+#define MACRAW_RX_RESERVE_CONTROL 2
+#define MACRAW_RX_RESERVE_FLOW (MACRAW_RX_RESERVE_CONTROL + PBUF_POOL_SIZE / 8)
+
+/* Flow cache : TCP segments of the registered test flows skip ethernet_input() and ip4_input() and are handed to
+ * tcp_input() once their headers match exactly, everything else takes the normal path. 0 disables it, 1 enables it
+ * and 2 only matches the flows and measures the cycles of the normal path, to compare against 1. */
+#ifndef NETIF_FLOW_CACHE
+#define NETIF_FLOW_CACHE 0
+#endif
+
+/* Number of flows the cache can hold, one per test stream */
+#define NETIF_FLOW_CACHE_SIZE 4
+
+#if (LWIP_PROFILE == LWIP_PROFILE_LOW_RAM)
+#define LWIP_PROFILE_NAME "low-RAM"
+
+#define MEM_SIZE 2048
+#define PBUF_POOL_SIZE 8
+#define MEMP_NUM_TCP_SEG 8
+
+#define TCP_SND_BUF     (2 * TCP_MSS)
+#define TCP_WND         (4 * TCP_MSS)
+#define TCP_QUEUE_OOSEQ 0
+
+#elif (LWIP_PROFILE == LWIP_PROFILE_BALANCED)
+#define LWIP_PROFILE_NAME "balanced"
+
+#define MEM_SIZE 4096
+#define PBUF_POOL_SIZE 16
+#define MEMP_NUM_TCP_SEG 16
+
 #define TCP_SND_BUF     (4 * TCP_MSS)
 #define TCP_WND         (8 * TCP_MSS)
+#define TCP_QUEUE_OOSEQ 1
+#define TCP_OOSEQ_MAX_PBUFS 8
+
+#elif (LWIP_PROFILE == LWIP_PROFILE_MAX_THROUGHPUT)
+#define LWIP_PROFILE_NAME "max-throughput"
+
+#define MEM_SIZE (16 * 1024)
+#define MEMP_NUM_TCP_SEG 64
+
+#define TCP_SND_BUF     (16 * TCP_MSS)
+#define TCP_SND_QUEUELEN (4 * TCP_SND_BUF / TCP_MSS)
+#define TCP_WND         (32 * TCP_MSS)
+#define TCP_QUEUE_OOSEQ 1
+#define TCP_OOSEQ_MAX_PBUFS 24
+
+/* A full receive window (the out-of-order queue fits in it), plus a full MACRAW RX burst, plus headroom for ACKs and control traffic */
+#define PBUF_POOL_SIZE ((TCP_WND + PBUF_POOL_TCP_PAYLOAD - 1) / PBUF_POOL_TCP_PAYLOAD + MACRAW_RX_BURST_DEPTH + 4)
+
+#else
+#error "LWIP_PROFILE is wrong"
+#endif
 
 #define LWIP_HTTPD_CGI 0
 #define LWIP_HTTPD_SSI 0
@@ -65,7 +186,7 @@
 
 #define LWIP_RAND_WIZ() ((u32_t)rand())
 
-#if 1
+#if !defined(NDEBUG) && (LWIP_PROFILE != LWIP_PROFILE_MAX_THROUGHPUT)
 #define LWIP_DEBUG 1
 #define TCP_DEBUG LWIP_DBG_OFF
 #define ETHARP_DEBUG LWIP_DBG_OFF
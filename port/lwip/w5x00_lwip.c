@@ -10,18 +10,54 @@
  * ----------------------------------------------------------------------------------------------------
  */
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "w5x00_lwip.h"
 
 #include "socket.h"
 
 #include "netif/etharp.h"
+#include "lwip/memp.h"
+#include "lwip/prot/ip.h"
+#include "lwip/stats.h"
+
+#if NETIF_FLOW_CACHE
+#include "lwip/ip.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/priv/tcp_priv.h"
+#include "hardware/structs/systick.h"
+#endif
+
+#if LWIP_DUAL_CORE
+#include "pico/platform.h"
+#include "hardware/sync.h"
+#endif
 
 /**
  * ----------------------------------------------------------------------------------------------------
  * Macros
  * ----------------------------------------------------------------------------------------------------
  */
+/* Socket */
+#define SOCKET_MACRAW 0
+
+/* Ethernet */
+#define ETHERNET_FRAME_MIN_SIZE 60
+
+/* Early drop, bytes read to classify a frame : Ethernet, IPv4 and TCP headers without options */
+#define NETIF_RX_HEAD_SIZE 64
+
+/* Ring between the cores, must be a power of 2 */
+#define NETIF_RING_SIZE 16
+
+/* Flow cache, Ethernet and IPv4 header without options */
+#define NETIF_FLOW_IP_OFFSET 14
+#define NETIF_FLOW_TCP_OFFSET (NETIF_FLOW_IP_OFFSET + 20)
+
+/* SysTick, 24-bit down counter clocked by the processor clock */
+#define SYSTICK_MAX 0x00FFFFFF
+#define SYSTICK_CSR_ENABLE_CLKSOURCE 0x5
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -30,8 +66,51 @@
  */
 uint8_t mac[6] = {0x00, 0x08, 0xDC, 0x12, 0x34, 0x56};
 
-static uint8_t tx_frame[1542];
-static const uint32_t ethernet_polynomial_le = 0xedb88320U;
+static const uint8_t tx_pad[ETHERNET_FRAME_MIN_SIZE] = {
+    0,
+};
+static bool tx_pending = false;
+
+static uint8_t macraw_filter = 0;
+static macraw_stats_t macraw_stats;
+static uint16_t rx_priority_port = 0;
+
+#if MACRAW_RX_BATCH
+/* Frames read in one burst, with the 2-byte length header of each frame */
+static uint8_t rx_batch[MACRAW_RX_BUF_SIZE];
+static uint16_t rx_batch_rd = 0;
+static uint16_t rx_batch_wr = 0;
+#endif
+
+#if LWIP_DUAL_CORE
+typedef struct
+{
+    struct pbuf *slot[NETIF_RING_SIZE];
+    volatile uint32_t head; // Written by the producer only
+    volatile uint32_t tail; // Written by the consumer only
+} netif_ring_t;
+
+static netif_ring_t rx_ring; // Core 0 -> core 1
+static netif_ring_t tx_ring; // Core 1 -> core 0
+
+static spin_lock_t *lwip_lock = NULL;
+static volatile int8_t lwip_lock_owner = -1;
+static uint8_t lwip_lock_depth = 0;
+#endif
+
+#if NETIF_FLOW_CACHE
+typedef struct
+{
+    bool valid;
+    uint8_t remote_ip[4];    // Network order, as in the IPv4 header
+    uint8_t remote_port[2];  // Network order, as in the TCP header
+    uint8_t local_port[2];
+} netif_flow_t;
+
+static netif_flow_t flow_cache[NETIF_FLOW_CACHE_SIZE];
+static uint32_t flow_frames = 0;
+static uint64_t flow_cycles = 0;
+#endif
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -107,18 +186,476 @@ int32_t recv_lwip(uint8_t sn, uint8_t *buf, uint16_t len)
     return (int32_t)pack_len;
 }
 
-err_t netif_output(struct netif *netif, struct pbuf *p)
+int8_t netif_macraw_open(uint8_t sn, uint8_t filter)
 {
-    uint32_t send_len = 0;
-    uint32_t tot_len = 0;
+    int8_t retval = 0;
 
-    memset(tx_frame, 0x00, sizeof(tx_frame));
+    memset(&macraw_stats, 0, sizeof(macraw_stats));
+    macraw_filter = filter;
+    tx_pending = false;
 
-    for (struct pbuf *q = p; q != NULL; q = q->next)
+#if MACRAW_RX_BATCH
+    rx_batch_rd = rx_batch_wr = 0;
+#endif
+
+    retval = socket(sn, Sn_MR_MACRAW, 0, filter);
+
+    return retval;
+}
+
+void netif_rx_priority_port(uint16_t port)
+{
+    rx_priority_port = port;
+}
+
+uint8_t netif_macraw_filter(void)
+{
+    return macraw_filter;
+}
+
+const macraw_stats_t *netif_macraw_stats(void)
+{
+    return &macraw_stats;
+}
+
+void netif_macraw_stats_print(void)
+{
+#if (_WIZCHIP_ == W5500)
+    printf(" MACRAW filter : MFEN %s, BCASTB %s, MMB %s, MIP6B %s\n",
+           (macraw_filter & Sn_MR_MFEN) ? "on" : "off",
+           (macraw_filter & Sn_MR_BCASTB) ? "on" : "off",
+           (macraw_filter & Sn_MR_MMB) ? "on" : "off",
+           (macraw_filter & Sn_MR_MIP6B) ? "on" : "off");
+#else
+    printf(" MACRAW filter : 0x%02X\n", macraw_filter);
+#endif
+    printf(" MACRAW frames : %u total, %u unicast, %u broadcast, %u multicast, %u IPv6, %u to other hosts\n",
+           macraw_stats.frames, macraw_stats.unicast, macraw_stats.broadcast,
+           macraw_stats.multicast, macraw_stats.ipv6, macraw_stats.foreign);
+    printf(" MACRAW drops  : %u control, %u test flow, %u other\n",
+           macraw_stats.dropped[NETIF_RX_CLASS_CONTROL], macraw_stats.dropped[NETIF_RX_CLASS_FLOW],
+           macraw_stats.dropped[NETIF_RX_CLASS_OTHER]);
+}
+
+/* Number of PBUF_POOL pbufs left */
+static uint16_t netif_rx_pool_free(void)
+{
+    return MEMP_STATS_GET(avail, MEMP_PBUF_POOL) - MEMP_STATS_GET(used, MEMP_PBUF_POOL);
+}
+
+/* Classify a frame from its first bytes : EtherType, IP protocol, ports and TCP payload length */
+static uint8_t netif_rx_classify(const uint8_t *frame, uint16_t len)
+{
+    uint16_t ihl = 0;
+    uint16_t ip_len = 0;
+    uint16_t src_port = 0;
+    uint16_t dst_port = 0;
+    const uint8_t *l4 = NULL;
+
+    if (len < 14)
+    {
+        return NETIF_RX_CLASS_OTHER;
+    }
+
+    // ARP
+    if (frame[12] == 0x08 && frame[13] == 0x06)
+    {
+        return NETIF_RX_CLASS_CONTROL;
+    }
+
+    // IPv4, not a fragment
+    if (frame[12] != 0x08 || frame[13] != 0x00 || len < 14 + 20 || ((frame[20] & 0x3F) | frame[21]) != 0)
+    {
+        return NETIF_RX_CLASS_OTHER;
+    }
+
+    ihl = (frame[14] & 0x0F) * 4;
+    ip_len = (frame[16] << 8) | frame[17];
+    l4 = frame + 14 + ihl;
+
+    if ((frame[23] != IP_PROTO_TCP && frame[23] != IP_PROTO_UDP) || len < 14 + ihl + 4)
+    {
+        return NETIF_RX_CLASS_OTHER;
+    }
+
+    src_port = (l4[0] << 8) | l4[1];
+    dst_port = (l4[2] << 8) | l4[3];
+
+    // TCP segment without payload
+    if (frame[23] == IP_PROTO_TCP && len >= 14 + ihl + 13 && ip_len <= ihl + (l4[12] >> 4) * 4)
+    {
+        return NETIF_RX_CLASS_CONTROL;
+    }
+
+    if (rx_priority_port != 0 && (src_port == rx_priority_port || dst_port == rx_priority_port))
+    {
+        return NETIF_RX_CLASS_FLOW;
+    }
+
+    return NETIF_RX_CLASS_OTHER;
+}
+
+/* Whether a frame of this class may take a pool pbuf, given the number left */
+static bool netif_rx_accept(uint8_t rx_class, uint16_t pool_free)
+{
+    switch (rx_class)
+    {
+    case NETIF_RX_CLASS_CONTROL:
+        return pool_free > 0;
+    case NETIF_RX_CLASS_FLOW:
+        return pool_free > MACRAW_RX_RESERVE_CONTROL;
+    default:
+        return pool_free > MACRAW_RX_RESERVE_FLOW;
+    }
+}
+
+/* Drop the rest of the current frame in the socket buffer */
+static void recv_lwip_drop(uint8_t sn, uint16_t len)
+{
+    if (len > 0)
+    {
+        wiz_recv_ignore(sn, len);
+    }
+    setSn_CR(sn, Sn_CR_RECV);
+    while (getSn_CR(sn))
+        ;
+
+    LINK_STATS_INC(link.drop);
+}
+
+/* A corrupt length header can not be trusted to skip the frame, so the socket is reopened to drop every pending frame */
+static void recv_lwip_resync(uint8_t sn)
+{
+    socket(sn, Sn_MR_MACRAW, 0, macraw_filter);
+
+    tx_pending = false;
+#if MACRAW_RX_BATCH
+    rx_batch_rd = rx_batch_wr = 0;
+#endif
+
+    LINK_STATS_INC(link.lenerr);
+    LINK_STATS_INC(link.drop);
+}
+
+/* Count a received frame by its destination MAC address and EtherType */
+static void macraw_count(const uint8_t *frame, uint16_t len)
+{
+    macraw_stats.frames++;
+
+    if (len < 14)
+    {
+        return;
+    }
+
+    if (frame[12] == 0x86 && frame[13] == 0xDD)
+    {
+        macraw_stats.ipv6++;
+    }
+    else if ((frame[0] & frame[1] & frame[2] & frame[3] & frame[4] & frame[5]) == 0xFF)
+    {
+        macraw_stats.broadcast++;
+    }
+    else if (frame[0] & 0x01)
+    {
+        macraw_stats.multicast++;
+    }
+    else if (memcmp(frame, mac, 6) == 0)
+    {
+        macraw_stats.unicast++;
+    }
+    else
+    {
+        macraw_stats.foreign++;
+    }
+}
+
+struct pbuf *recv_lwip_pbuf(uint8_t sn)
+{
+    uint8_t head[NETIF_RX_HEAD_SIZE];
+    uint16_t pack_len = 0;
+    uint16_t head_len = 0;
+    uint16_t pool_free = 0;
+    uint8_t rx_class = 0;
+    struct pbuf *p = NULL;
+    struct pbuf *q = NULL;
+
+    // byte size of data packet (2byte)
+    wiz_recv_data(sn, head, 2);
+
+    pack_len = head[0];
+    pack_len = (pack_len << 8) + head[1];
+
+    if (pack_len < 2 || pack_len - 2 > ETHERNET_FRAME_MAX_SIZE)
+    {
+        // Length header is out of range - the frames can not be walked any further
+        recv_lwip_resync(sn);
+
+        return NULL;
+    }
+
+    pack_len -= 2;
+
+    pool_free = netif_rx_pool_free();
+
+    if (pool_free <= MACRAW_RX_RESERVE_FLOW)
+    {
+        // The pool runs low - read the headers first and keep the pbuf for a more important frame if needed
+        head_len = pack_len < sizeof(head) ? pack_len : sizeof(head);
+        wiz_recv_data(sn, head, head_len);
+
+        macraw_count(head, head_len);
+
+        rx_class = netif_rx_classify(head, head_len);
+        if (!netif_rx_accept(rx_class, pool_free))
+        {
+            recv_lwip_drop(sn, pack_len - head_len);
+
+            macraw_stats.dropped[rx_class]++;
+
+            return NULL;
+        }
+    }
+
+    p = pbuf_alloc(PBUF_RAW, pack_len, PBUF_POOL);
+
+    if (p == NULL)
+    {
+        // Out of pool pbufs - drop the packet
+        recv_lwip_drop(sn, pack_len - head_len);
+
+        LINK_STATS_INC(link.memerr);
+
+        return NULL;
+    }
+
+    // Read the frame straight into the pool buffers, one burst per pbuf
+    if (head_len > 0)
+    {
+        // A pool pbuf is always larger than the headers
+        MEMCPY(p->payload, head, head_len);
+        wiz_recv_data(sn, (uint8_t *)p->payload + head_len, p->len - head_len);
+    }
+    else
+    {
+        wiz_recv_data(sn, p->payload, p->len);
+    }
+
+    for (q = p->next; q != NULL; q = q->next)
+    {
+        wiz_recv_data(sn, q->payload, q->len);
+    }
+
+    setSn_CR(sn, Sn_CR_RECV);
+    while (getSn_CR(sn))
+        ;
+
+    if (head_len == 0)
+    {
+        macraw_count(p->payload, p->len);
+    }
+
+    LINK_STATS_INC(link.recv);
+
+    return p;
+}
+
+#if LWIP_DUAL_CORE
+static bool netif_ring_push(netif_ring_t *ring, struct pbuf *p)
+{
+    uint32_t head = ring->head;
+
+    if (head - ring->tail == NETIF_RING_SIZE)
+    {
+        return false;
+    }
+
+    ring->slot[head & (NETIF_RING_SIZE - 1)] = p;
+
+    // Publish the slot before the index
+    __mem_fence_release();
+    ring->head = head + 1;
+
+    return true;
+}
+
+static struct pbuf *netif_ring_pop(netif_ring_t *ring)
+{
+    uint32_t tail = ring->tail;
+    struct pbuf *p = NULL;
+
+    if (tail == ring->head)
+    {
+        return NULL;
+    }
+
+    __mem_fence_acquire();
+    p = ring->slot[tail & (NETIF_RING_SIZE - 1)];
+
+    // The slot is read before it is handed back to the producer
+    __mem_fence_release();
+    ring->tail = tail + 1;
+
+    return p;
+}
+#endif
+
+#if MACRAW_RX_BATCH
+/* A corrupt length header would never be completed, so it is acted on as soon as it is seen */
+static bool rx_batch_has_frame(uint8_t sn)
+{
+    uint16_t pack_len = 0;
+
+    if (rx_batch_wr - rx_batch_rd < 2)
+    {
+        return false;
+    }
+
+    pack_len = (rx_batch[rx_batch_rd] << 8) + rx_batch[rx_batch_rd + 1];
+
+    if (pack_len < 2 || pack_len - 2 > ETHERNET_FRAME_MAX_SIZE)
+    {
+        // The frames can not be walked any further - drop the burst, and the socket data it was read from
+        recv_lwip_resync(sn);
+
+        return false;
+    }
+
+    return pack_len <= rx_batch_wr - rx_batch_rd;
+}
+
+uint16_t recv_lwip_batch(uint8_t sn, struct pbuf **frames, uint16_t max)
+{
+    uint16_t pool_free = 0;
+    uint8_t rx_class = 0;
+    uint16_t count = 0;
+    uint16_t pack_len = 0;
+    uint16_t len = 0;
+    struct pbuf *p = NULL;
+
+    // Only go to the chip once every complete frame in the buffer has been handed over
+    if (!rx_batch_has_frame(sn))
+    {
+        // Move a partial frame left by the previous burst to the front
+        len = rx_batch_wr - rx_batch_rd;
+        if (len > 0 && rx_batch_rd > 0)
+        {
+            memmove(rx_batch, rx_batch + rx_batch_rd, len);
+        }
+        rx_batch_rd = 0;
+        rx_batch_wr = len;
+
+        len = getSn_RX_RSR(sn);
+        if (len > sizeof(rx_batch) - rx_batch_wr)
+        {
+            len = sizeof(rx_batch) - rx_batch_wr;
+        }
+
+        if (len == 0)
+        {
+            return 0;
+        }
+
+        // One burst and one RECV for every frame pending in the socket buffer
+        wiz_recv_data(sn, rx_batch + rx_batch_wr, len);
+        setSn_CR(sn, Sn_CR_RECV);
+        while (getSn_CR(sn))
+            ;
+
+        rx_batch_wr += len;
+    }
+
+    while (count < max && rx_batch_has_frame(sn))
+    {
+        pack_len = (rx_batch[rx_batch_rd] << 8) + rx_batch[rx_batch_rd + 1];
+
+        macraw_count(rx_batch + rx_batch_rd + 2, pack_len - 2);
+
+        pool_free = netif_rx_pool_free();
+        rx_class = netif_rx_classify(rx_batch + rx_batch_rd + 2, pack_len - 2);
+
+        // The frame is already in RAM, so classifying it costs no SPI transfer
+        if (!netif_rx_accept(rx_class, pool_free))
+        {
+            macraw_stats.dropped[rx_class]++;
+            LINK_STATS_INC(link.drop);
+
+            p = NULL;
+        }
+        else if ((p = pbuf_alloc(PBUF_RAW, pack_len - 2, PBUF_POOL)) == NULL)
+        {
+            // Out of pool pbufs - drop the packet
+            LINK_STATS_INC(link.memerr);
+            LINK_STATS_INC(link.drop);
+        }
+        else
+        {
+            pbuf_take(p, rx_batch + rx_batch_rd + 2, pack_len - 2);
+            frames[count++] = p;
+
+            LINK_STATS_INC(link.recv);
+        }
+
+        rx_batch_rd += pack_len;
+    }
+
+    if (rx_batch_rd == rx_batch_wr)
+    {
+        rx_batch_rd = rx_batch_wr = 0;
+    }
+
+    return count;
+}
+#endif
+
+static void wait_lwip_sendok(uint8_t sn)
+{
+    uint8_t ir = 0;
+
+    if (!tx_pending)
+    {
+        return;
+    }
+
+    // Wait until the previous frame has left the TX buffer
+    do
     {
-        memcpy(tx_frame + tot_len, q->payload, q->len);
+        ir = getSn_IR(sn) & (Sn_IR_SENDOK | Sn_IR_TIMEOUT);
+        if (ir)
+        {
+            setSn_IR(sn, ir);
+            break;
+        }
+    } while (getSn_TX_FSR(sn) != getSn_TxMAX(sn));
 
-        tot_len += q->len;
+    tx_pending = false;
+}
+
+static err_t send_lwip_pbuf(uint8_t sn, struct pbuf *p)
+{
+    uint16_t tot_len = p->tot_len;
+    uint16_t send_len = tot_len;
+
+    if (send_len < ETHERNET_FRAME_MIN_SIZE)
+    {
+        // pad
+        send_len = ETHERNET_FRAME_MIN_SIZE;
+    }
+
+    if (send_len > getSn_TxMAX(sn))
+    {
+        LINK_STATS_INC(link.lenerr);
+        LINK_STATS_INC(link.drop);
+
+        return ERR_BUF;
+    }
+
+    // Sn_TX_WR must not move while the previous SEND runs, its frame length is taken from it
+    wait_lwip_sendok(sn);
+
+    // Stream each segment straight into the TX buffer
+    for (struct pbuf *q = p; q != NULL; q = q->next)
+    {
+        wiz_send_data(sn, q->payload, q->len);
 
         if (q->len == q->tot_len)
         {
@@ -126,19 +663,38 @@ err_t netif_output(struct netif *netif, struct pbuf *p)
         }
     }
 
-    if (tot_len < 60)
+    if (tot_len < send_len)
     {
-        // pad
-        tot_len = 60;
+        wiz_send_data(sn, (uint8_t *)tx_pad, send_len - tot_len);
     }
 
-    uint32_t crc = ethernet_frame_crc(tx_frame, tot_len);
+    setSn_CR(sn, Sn_CR_SEND);
+    while (getSn_CR(sn))
+        ;
 
-    send_len = send_lwip(0, tx_frame, tot_len);
+    tx_pending = true;
+
+    LINK_STATS_INC(link.xmit);
 
     return ERR_OK;
 }
 
+err_t netif_output(struct netif *netif, struct pbuf *p)
+{
+#if LWIP_DUAL_CORE
+    // Core 0 owns the SPI bus, it sends the frame and releases the reference
+    pbuf_ref(p);
+    while (!netif_ring_push(&tx_ring, p))
+    {
+        tight_loop_contents();
+    }
+
+    return ERR_OK;
+#else
+    return send_lwip_pbuf(SOCKET_MACRAW, p);
+#endif
+}
+
 void netif_link_callback(struct netif *netif)
 {
     printf("netif link status changed %s\n", netif_is_link_up(netif) ? "up" : "down");
@@ -160,25 +716,251 @@ err_t netif_initialize(struct netif *netif)
     return ERR_OK;
 }
 
-static uint32_t ethernet_frame_crc(const uint8_t *data, int length)
+#if LWIP_DUAL_CORE
+void netif_io_initialize(void)
 {
-    uint32_t crc = 0xffffffff; /* Initial value. */
+    lwip_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    spin_lock_init(lwip_lock);
+}
 
-    while (--length >= 0)
+uint32_t netif_arch_protect(void)
+{
+    uint32_t save = save_and_disable_interrupts();
+    int8_t core = (int8_t)get_core_num();
+
+    // lwIP may nest protected sections, only the outermost one takes the lock
+    if (lwip_lock_owner != core)
     {
-        uint8_t current_octet = *data++;
+        spin_lock_unsafe_blocking(lwip_lock);
+        lwip_lock_owner = core;
+    }
+    lwip_lock_depth++;
 
-        for (int bit = 8; --bit >= 0; current_octet >>= 1)
+    return save;
+}
+
+void netif_arch_unprotect(uint32_t save)
+{
+    if (--lwip_lock_depth == 0)
+    {
+        lwip_lock_owner = -1;
+        spin_unlock_unsafe(lwip_lock);
+    }
+
+    restore_interrupts(save);
+}
+
+void netif_io_process(uint8_t sn)
+{
+#if MACRAW_RX_BATCH
+    struct pbuf *frames[NETIF_RING_SIZE];
+    uint16_t count = 0;
+#else
+    uint16_t pack_len = 0;
+#endif
+    struct pbuf *p = NULL;
+
+    // Send first, so ACKs are not held back behind a receive burst
+    while ((p = netif_ring_pop(&tx_ring)) != NULL)
+    {
+        send_lwip_pbuf(sn, p);
+        pbuf_free(p);
+    }
+
+    // Leave the frame in the socket buffer until core 1 has caught up
+    if (rx_ring.head - rx_ring.tail == NETIF_RING_SIZE)
+    {
+        return;
+    }
+
+#if MACRAW_RX_BATCH
+    count = recv_lwip_batch(sn, frames, NETIF_RING_SIZE - (rx_ring.head - rx_ring.tail));
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        netif_ring_push(&rx_ring, frames[i]);
+    }
+#else
+    getsockopt(sn, SO_RECVBUF, &pack_len);
+
+    if (pack_len > 0)
+    {
+        p = recv_lwip_pbuf(sn);
+
+        if (p != NULL)
+        {
+            netif_ring_push(&rx_ring, p);
+        }
+    }
+#endif
+}
+
+void netif_rx_process(struct netif *netif)
+{
+    struct pbuf *p = NULL;
+
+    while ((p = netif_ring_pop(&rx_ring)) != NULL)
+    {
+        if (netif->input(p, netif) != ERR_OK)
         {
-            if ((crc ^ current_octet) & 1)
-            {
-                crc >>= 1;
-                crc ^= ethernet_polynomial_le;
-            }
-            else
-                crc >>= 1;
+            pbuf_free(p);
         }
     }
+}
+#endif
+
+#if NETIF_FLOW_CACHE
+void netif_flow_cache_add(const ip_addr_t *remote_ip, uint16_t remote_port, uint16_t local_port)
+{
+    for (uint8_t i = 0; i < NETIF_FLOW_CACHE_SIZE; i++)
+    {
+        netif_flow_t *flow = &flow_cache[i];
+
+        if (!flow->valid)
+        {
+            memcpy(flow->remote_ip, &ip_2_ip4(remote_ip)->addr, 4);
+            flow->remote_port[0] = (uint8_t)(remote_port >> 8);
+            flow->remote_port[1] = (uint8_t)remote_port;
+            flow->local_port[0] = (uint8_t)(local_port >> 8);
+            flow->local_port[1] = (uint8_t)local_port;
+            flow->valid = true;
+
+            return;
+        }
+    }
+}
+
+void netif_flow_cache_clear(void)
+{
+    memset(flow_cache, 0, sizeof(flow_cache));
+}
+
+void netif_flow_cache_stats_print(void)
+{
+    if (flow_frames == 0)
+    {
+        return;
+    }
+
+    printf(" Flow cache    : %u frames on the %s path, %u cycles per frame\n",
+           flow_frames, NETIF_FLOW_CACHE == 1 ? "fast" : "normal", (uint32_t)(flow_cycles / flow_frames));
+
+    flow_frames = 0;
+    flow_cycles = 0;
+}
+
+/* Exact match of a frame against the cached flows : own MAC address and IPv4 address, IPv4 without options
+ * and not a fragment, TCP, remote address and both ports. Every field the normal path would demultiplex on is compared. */
+static bool netif_flow_match(const struct pbuf *p, const struct netif *netif)
+{
+    const uint8_t *frame = (const uint8_t *)p->payload;
+    const uint8_t *tcp = frame + NETIF_FLOW_TCP_OFFSET;
+
+    if (p->len < NETIF_FLOW_TCP_OFFSET + TCP_HLEN ||
+        memcmp(frame, netif->hwaddr, 6) != 0 ||
+        frame[12] != 0x08 || frame[13] != 0x00 ||
+        frame[14] != 0x45 || ((frame[20] & 0x3F) | frame[21]) != 0 ||
+        frame[23] != IP_PROTO_TCP ||
+        memcmp(frame + 30, &netif_ip4_addr(netif)->addr, 4) != 0)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < NETIF_FLOW_CACHE_SIZE; i++)
+    {
+        const netif_flow_t *flow = &flow_cache[i];
+
+        if (flow->valid &&
+            memcmp(frame + 26, flow->remote_ip, 4) == 0 &&
+            memcmp(tcp, flow->remote_port, 2) == 0 &&
+            memcmp(tcp + 2, flow->local_port, 2) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#if NETIF_FLOW_CACHE == 1
+/* The part of ip4_input() a matched segment still needs : header checksum, length, then tcp_input() */
+static bool netif_flow_deliver(struct pbuf *p, struct netif *netif)
+{
+    struct ip_hdr *iphdr = (struct ip_hdr *)((uint8_t *)p->payload + NETIF_FLOW_IP_OFFSET);
+    uint16_t iphdr_len = lwip_ntohs(IPH_LEN(iphdr));
+
+    if (iphdr_len < IP_HLEN + TCP_HLEN || iphdr_len > p->tot_len - NETIF_FLOW_IP_OFFSET)
+    {
+        return false;
+    }
+#if CHECKSUM_CHECK_IP
+    if (inet_chksum(iphdr, IP_HLEN) != 0)
+    {
+        return false;
+    }
+#endif
+
+    pbuf_remove_header(p, NETIF_FLOW_IP_OFFSET);
+
+    // Ethernet padding of short frames
+    if (p->tot_len > iphdr_len)
+    {
+        pbuf_realloc(p, iphdr_len);
+    }
+
+    ip_data.current_netif = netif;
+    ip_data.current_input_netif = netif;
+    ip_data.current_ip4_header = iphdr;
+    ip_data.current_ip_header_tot_len = IP_HLEN;
+    ip4_addr_copy(*ip4_current_dest_addr(), iphdr->dest);
+    ip4_addr_copy(*ip4_current_src_addr(), iphdr->src);
+
+    pbuf_remove_header(p, IP_HLEN);
+    tcp_input(p, netif);
+
+    // Same cleanup as ip4_input()
+    ip_data.current_netif = NULL;
+    ip_data.current_input_netif = NULL;
+    ip_data.current_ip4_header = NULL;
+    ip_data.current_ip_header_tot_len = 0;
+    ip4_addr_set_any(ip4_current_src_addr());
+    ip4_addr_set_any(ip4_current_dest_addr());
+
+    return true;
+}
+#endif
+
+err_t netif_flow_input(struct pbuf *p, struct netif *netif)
+{
+    uint32_t start = 0;
+    err_t err = ERR_OK;
+
+    if (!netif_flow_match(p, netif))
+    {
+        return netif_input(p, netif);
+    }
+
+    // SysTick is per core, it is started by the core that runs lwIP
+    if ((systick_hw->csr & SYSTICK_CSR_ENABLE_CLKSOURCE) != SYSTICK_CSR_ENABLE_CLKSOURCE)
+    {
+        systick_hw->rvr = SYSTICK_MAX;
+        systick_hw->cvr = 0;
+        systick_hw->csr = SYSTICK_CSR_ENABLE_CLKSOURCE;
+    }
+    start = systick_hw->cvr;
+
+#if NETIF_FLOW_CACHE == 1
+    if (!netif_flow_deliver(p, netif))
+    {
+        err = netif_input(p, netif);
+    }
+#else
+    err = netif_input(p, netif);
+#endif
+
+    flow_cycles += (start - systick_hw->cvr) & SYSTICK_MAX;
+    flow_frames++;
 
-    return ~crc;
+    return err;
 }
+#endif
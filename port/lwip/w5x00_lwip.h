@@ -14,6 +14,8 @@
  */
 #include "lwip/netif.h"
 
+#include "wizchip_conf.h"
+
 /**
  * ----------------------------------------------------------------------------------------------------
  * Macros
@@ -21,18 +23,96 @@
  */
 /* LWIP */
 #define ETHERNET_MTU 1500
+#define ETHERNET_FRAME_MAX_SIZE (ETHERNET_MTU + 14)
+
+/* MACRAW filter, Sn_MR flags of the MACRAW socket */
+#if (_WIZCHIP_ == W5500)
+/* Own MAC address and broadcast only, no multicast, no IPv6. Broadcast must not be blocked, ARP needs it */
+#define MACRAW_FILTER_DEFAULT (Sn_MR_MFEN | Sn_MR_MMB | Sn_MR_MIP6B)
+#else
+#define MACRAW_FILTER_DEFAULT 0x20
+#endif
+
+/* Receive classes of the early drop, in order of priority */
+#define NETIF_RX_CLASS_CONTROL 0 // ARP and TCP segments without payload
+#define NETIF_RX_CLASS_FLOW 1    // TCP and UDP to or from the test port
+#define NETIF_RX_CLASS_OTHER 2
+#define NETIF_RX_CLASS_NUM 3
 
 /**
  * ----------------------------------------------------------------------------------------------------
  * Variables
  * ----------------------------------------------------------------------------------------------------
  */
+/* Frames that reached software through the MACRAW socket, by destination */
+typedef struct
+{
+    uint32_t frames;    // Every frame read from the socket
+    uint32_t unicast;   // To the own MAC address
+    uint32_t broadcast; // Blocked by BCASTB
+    uint32_t multicast; // Blocked by MMB, except IPv6 multicast
+    uint32_t ipv6;      // Blocked by MIP6B
+    uint32_t foreign;   // Unicast to another MAC address, blocked by MFEN
+
+    uint32_t dropped[NETIF_RX_CLASS_NUM]; // Dropped by the early drop, by receive class
+} macraw_stats_t;
 
 /**
  * ----------------------------------------------------------------------------------------------------
  * Functions
  * ----------------------------------------------------------------------------------------------------
  */
+/*! \brief open the MACRAW socket
+ *  \ingroup w5x00_lwip
+ *
+ *  Open or reopen the MACRAW socket with the given filter and clear the frame counters.
+ *  On the W5500, filter is a combination of Sn_MR_MFEN, Sn_MR_BCASTB, Sn_MR_MMB and Sn_MR_MIP6B.
+ *  Frames blocked by the filter are dropped by the chip and never cross the SPI bus.
+ *  It can be called between tests to change the filter; frames pending in the socket are lost.
+ *
+ *  \param sn socket number
+ *  \param filter Sn_MR filter flags
+ *  \return the socket number, or a negative value on error
+ */
+int8_t netif_macraw_open(uint8_t sn, uint8_t filter);
+
+/*! \brief set the test port of the early drop
+ *  \ingroup w5x00_lwip
+ *
+ *  TCP and UDP frames to or from this port are kept before other traffic when the pbuf pool runs low.
+ *
+ *  \param port test port
+ */
+void netif_rx_priority_port(uint16_t port);
+
+/*! \brief MACRAW filter
+ *  \ingroup w5x00_lwip
+ *
+ *  \param none
+ *  \return the filter flags the MACRAW socket was opened with
+ */
+uint8_t netif_macraw_filter(void);
+
+/*! \brief MACRAW frame counters
+ *  \ingroup w5x00_lwip
+ *
+ *  Counters of the frames read from the MACRAW socket, by destination.
+ *  The W5500 does not count the frames it filters, so the counters show what still reaches
+ *  software: a class that keeps counting while its block flag is clear is traffic the
+ *  filter would have kept off the SPI bus.
+ *
+ *  \param none
+ *  \return the counters since the socket was opened
+ */
+const macraw_stats_t *netif_macraw_stats(void);
+
+/*! \brief print the MACRAW filter and frame counters
+ *  \ingroup w5x00_lwip
+ *
+ *  \param none
+ */
+void netif_macraw_stats_print(void);
+
 /*! \brief send an ethernet packet
  *  \ingroup w5x00_lwip
  *
@@ -57,16 +137,55 @@ int32_t send_lwip(uint8_t sn, uint8_t *buf, uint16_t len);
  */
 int32_t recv_lwip(uint8_t sn, uint8_t *buf, uint16_t len);
 
+/*! \brief read an ethernet packet into a pbuf
+ *  \ingroup w5x00_lwip
+ *
+ *  It is used to read one incoming MACRAW frame directly into pbufs taken from PBUF_POOL.
+ *  The frame is transferred segment by segment, so no heap memory or intermediate buffer is used.
+ *  When the pool runs low, the headers are read first and the frame is classified; frames of a
+ *  class the pool level no longer allows are dropped in the socket buffer without reading the rest.
+ *  A corrupt length header gives no way to find the next frame, so the socket is reopened and
+ *  every pending frame is lost.
+ *  The caller must make sure that data is pending (Sn_RX_RSR > 0) before calling it.
+ *
+ *  \param sn socket number
+ *  \return a pbuf chain holding the frame, or NULL if the frame was dropped
+ */
+struct pbuf *recv_lwip_pbuf(uint8_t sn);
+
+#if MACRAW_RX_BATCH
+/*! \brief read ethernet packets in one burst
+ *  \ingroup w5x00_lwip
+ *
+ *  It is used to read every pending MACRAW frame with a single Sn_RX_RSR read, one SPI burst
+ *  and one RECV command. The frames are split in RAM by their length headers and copied into
+ *  pbufs taken from PBUF_POOL. Complete frames beyond max, and a frame cut at the end of the
+ *  burst, are kept in RAM for the next call, which only reads the socket again once they are used up.
+ *  A corrupt length header reopens the socket, as in recv_lwip_pbuf().
+ *
+ *  \param sn socket number
+ *  \param frames array receiving one pbuf chain per frame
+ *  \param max the number of entries in frames
+ *  \return the number of frames stored in frames
+ */
+uint16_t recv_lwip_batch(uint8_t sn, struct pbuf **frames, uint16_t max);
+#endif
+
 /*! \brief callback function
  *  \ingroup w5x00_lwip
  *
  *  This function is called by ethernet_output() when it wants
  *  to send a packet on the interface. This function outputs
  *  the pbuf as-is on the link medium.
+ *  Each pbuf segment is written directly to the socket TX buffer and the frame is
+ *  padded only when it is shorter than the Ethernet minimum. SEND is issued without
+ *  waiting for SENDOK; the wait happens before the next frame is written, since the chip
+ *  takes the length of a MACRAW frame from Sn_TX_WR, which must not move under a SEND.
  *
  *  \param netif a pre-allocated netif structure
  *  \param p main packet buffer struct
  *  \return ERR_OK if data was sent.
+ *  In the dual-core build, the frame is only queued here and sent by netif_io_process() on core 0.
  */
 err_t netif_output(struct netif *netif, struct pbuf *p);
 
@@ -98,15 +217,105 @@ void netif_status_callback(struct netif *netif);
  */
 err_t netif_initialize(struct netif *netif);
 
-/*! \brief ethernet frame cyclic redundancy check
+#if LWIP_DUAL_CORE
+/*! \brief initialize the dual-core interface
+ *  \ingroup w5x00_lwip
+ *
+ *  Claim the spin lock shared by both cores for lwIP protected sections.
+ *  It must be called before lwip_init().
+ *
+ *  \param none
+ */
+void netif_io_initialize(void);
+
+/*! \brief lwIP protected section
+ *  \ingroup w5x00_lwip
+ *
+ *  SYS_ARCH_PROTECT() for the dual-core build. Interrupts are disabled and the
+ *  shared spin lock is taken, so the pbuf pools can be used from both cores.
+ *  Sections can be nested on the same core.
+ *
+ *  \param none
+ *  \return the interrupt state to pass to netif_arch_unprotect()
+ */
+uint32_t netif_arch_protect(void);
+
+/*! \brief lwIP protected section
+ *  \ingroup w5x00_lwip
+ *
+ *  SYS_ARCH_UNPROTECT() for the dual-core build.
+ *
+ *  \param save the value returned by netif_arch_protect()
+ */
+void netif_arch_unprotect(uint32_t save);
+
+/*! \brief run the MACRAW socket I/O
+ *  \ingroup w5x00_lwip
+ *
+ *  It is called in a loop on core 0, which owns the SPI bus.
+ *  Frames queued by netif_output() on core 1 are written to the socket, then one received
+ *  frame is read into pbufs and passed to core 1 through a lock-free ring.
+ *
+ *  \param sn socket number
+ */
+void netif_io_process(uint8_t sn);
+
+/*! \brief input received frames
+ *  \ingroup w5x00_lwip
+ *
+ *  It is called in a loop on core 1, which runs lwIP.
+ *  Every frame received by core 0 is passed to netif->input().
+ *
+ *  \param netif a pre-allocated netif structure
+ */
+void netif_rx_process(struct netif *netif);
+#endif
+
+#if NETIF_FLOW_CACHE
+/*! \brief add a flow to the flow cache
  *  \ingroup w5x00_lwip
  *
- *  Perform cyclic redundancy check on ethernet frame
+ *  TCP segments from remote_ip:remote_port to local_port are recognized by netif_flow_input()
+ *  and handed to tcp_input() without going through ethernet_input() and ip4_input().
+ *  Nothing is added when the cache is full.
  *
- *  \param data a pointer to the ethernet frame
- *  \param length the total length of ethernet frame
- *  \return an ethernet frame cyclic redundancy check result value
+ *  \param remote_ip remote IPv4 address
+ *  \param remote_port remote TCP port
+ *  \param local_port local TCP port
+ */
+void netif_flow_cache_add(const ip_addr_t *remote_ip, uint16_t remote_port, uint16_t local_port);
+
+/*! \brief clear the flow cache
+ *  \ingroup w5x00_lwip
+ *
+ *  Remove every flow, the cycle counters are kept until netif_flow_cache_stats_print().
+ *
+ *  \param none
+ */
+void netif_flow_cache_clear(void);
+
+/*! \brief print the flow cache counters
+ *  \ingroup w5x00_lwip
+ *
+ *  Print the number of frames that matched a cached flow and their average input cycles,
+ *  then clear the counters.
+ *
+ *  \param none
+ */
+void netif_flow_cache_stats_print(void);
+
+/*! \brief callback function
+ *  \ingroup w5x00_lwip
+ *
+ *  Input function of the netif, passed to netif_add() instead of netif_input().
+ *  A frame that matches a cached flow exactly is checked like ip4_input() would and passed to
+ *  tcp_input(); any other frame, or one that fails a check, is passed to netif_input().
+ *
+ *  \param p received frame
+ *  \param netif a pre-allocated netif structure
+ *  \return ERR_OK if the frame was consumed
  */
-static uint32_t ethernet_frame_crc(const uint8_t *data, int length);
+err_t netif_flow_input(struct pbuf *p, struct netif *netif);
+#endif
 
 #endif /* _W5x00_LWIP_H_ */
@@ -0,0 +1,268 @@
+/**
+ * Copyright (c) 2022 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * Host check and micro-benchmark of the lwIP port checksum against lwip_standard_chksum().
+ *
+ * Build and run from the repository root :
+ *
+ *   gcc -O2 -Iport/lwip -o fast_chksum_bench tools/fast_chksum_bench.c port/lwip/fast_chksum.c
+ *   ./fast_chksum_bench
+ *
+ * fast_chksum() and fast_chksum_copy() must return the same value as lwIP for random lengths and for
+ * every source and destination alignment, odd lengths and odd addresses included, and the copy must
+ * match the source without writing past its end. The reference below is lwip_standard_chksum() of
+ * lwIP 2.1 (src/core/inet_chksum.c, LWIP_CHKSUM_ALGORITHM 3), so no lwIP tree is needed.
+ *
+ * On the host, fast_chksum.c builds its portable C loop, the add-with-carry chains of the RP2040 and
+ * RP2350 are only used in the firmware. The timings compare the algorithms, not the targets.
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fast_chksum.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Checksum */
+#define FOLD_U32T(u) (((u) >> 16) + ((u) & 0x0000FFFFUL))
+#define SWAP_BYTES_IN_WORD(w) ((((w) & 0xFF) << 8) | (((w) & 0xFF00) >> 8))
+
+/* Buffers, the largest length plus room for the offsets and the guard bytes */
+#define MAX_LEN 2048
+#define BUF_SIZE (MAX_LEN + 64)
+#define GUARD 0xA5
+
+#define CHECKS 200000
+#define ITERATIONS 1000000
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+static uint8_t g_src[BUF_SIZE] __attribute__((aligned(8)));
+static uint8_t g_dst[BUF_SIZE] __attribute__((aligned(8)));
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* lwip_standard_chksum() of lwIP 2.1, algorithm 3 */
+static uint16_t lwip_standard_chksum(const void *dataptr, int len)
+{
+    const uint8_t *pb = (const uint8_t *)dataptr;
+    const uint16_t *ps;
+    uint16_t t = 0;
+    const uint32_t *pl;
+    uint32_t sum = 0, tmp;
+    int odd = ((uintptr_t)pb & 1);
+
+    if (odd && len > 0)
+    {
+        ((uint8_t *)&t)[1] = *pb++;
+        len--;
+    }
+
+    ps = (const uint16_t *)(const void *)pb;
+
+    if (((uintptr_t)ps & 3) && len > 1)
+    {
+        sum += *ps++;
+        len -= 2;
+    }
+
+    pl = (const uint32_t *)(const void *)ps;
+
+    while (len > 7)
+    {
+        tmp = sum + *pl++;
+        if (tmp < sum)
+        {
+            tmp++;
+        }
+        sum = tmp + *pl++;
+        if (sum < tmp)
+        {
+            sum++;
+        }
+        len -= 8;
+    }
+
+    sum = FOLD_U32T(sum);
+
+    ps = (const uint16_t *)pl;
+
+    while (len > 1)
+    {
+        sum += *ps++;
+        len -= 2;
+    }
+
+    if (len > 0)
+    {
+        ((uint8_t *)&t)[0] = *(const uint8_t *)ps;
+    }
+
+    sum += t;
+
+    sum = FOLD_U32T(sum);
+    sum = FOLD_U32T(sum);
+
+    if (odd)
+    {
+        sum = SWAP_BYTES_IN_WORD(sum);
+    }
+
+    return (uint16_t)sum;
+}
+
+static int check(void)
+{
+    uint32_t len = 0;
+    uint32_t src_offset = 0;
+    uint32_t dst_offset = 0;
+    uint16_t expected = 0;
+    uint16_t sum = 0;
+
+    for (uint32_t i = 0; i < CHECKS; i++)
+    {
+        // Every length up to a full frame first, then random ones, each with every pair of alignments in turn
+        len = (i <= 1600) ? i : (uint32_t)rand() % (MAX_LEN + 1);
+        src_offset = i % 8;
+        dst_offset = (i / 8) % 8;
+
+        for (uint32_t j = 0; j < len; j++)
+        {
+            g_src[src_offset + j] = (uint8_t)rand();
+        }
+        memset(g_dst, GUARD, sizeof(g_dst));
+
+        expected = lwip_standard_chksum(g_src + src_offset, len);
+
+        sum = fast_chksum(g_src + src_offset, len);
+        if (sum != expected)
+        {
+            printf("fast_chksum      : len %u, src offset %u : 0x%04x instead of 0x%04x\n", len, src_offset, sum, expected);
+            return 1;
+        }
+
+        sum = fast_chksum_copy(g_dst + dst_offset, g_src + src_offset, len);
+        if (sum != expected)
+        {
+            printf("fast_chksum_copy : len %u, src offset %u, dst offset %u : 0x%04x instead of 0x%04x\n",
+                   len, src_offset, dst_offset, sum, expected);
+            return 1;
+        }
+
+        if (memcmp(g_dst + dst_offset, g_src + src_offset, len) != 0)
+        {
+            printf("fast_chksum_copy : len %u, src offset %u, dst offset %u : wrong copy\n", len, src_offset, dst_offset);
+            return 1;
+        }
+
+        for (uint32_t j = 0; j < sizeof(g_dst); j++)
+        {
+            if ((j < dst_offset || j >= dst_offset + len) && g_dst[j] != GUARD)
+            {
+                printf("fast_chksum_copy : len %u, src offset %u, dst offset %u : byte %u written\n",
+                       len, src_offset, dst_offset, j);
+                return 1;
+            }
+        }
+    }
+
+    printf("%u lengths and alignments match lwip_standard_chksum\n", CHECKS);
+
+    return 0;
+}
+
+static void bench(const char *name, uint32_t len, uint32_t src_offset, uint32_t dst_offset)
+{
+    uint32_t iterations = ITERATIONS * 64 / (len + 64);
+    volatile uint32_t sink = 0;
+    double t_lwip = 0;
+    double t_fast = 0;
+    double t_lwip_copy = 0;
+    double t_fast_copy = 0;
+    double start = 0;
+
+    start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        sink += lwip_standard_chksum(g_src + src_offset, len);
+    }
+    t_lwip = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        sink += fast_chksum(g_src + src_offset, len);
+    }
+    t_fast = (now_ns() - start) / iterations;
+
+    // What lwIP does without fast_chksum_copy(): copy, then read the copy again
+    start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        memcpy(g_dst + dst_offset, g_src + src_offset, len);
+        sink += lwip_standard_chksum(g_dst + dst_offset, len);
+    }
+    t_lwip_copy = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        sink += fast_chksum_copy(g_dst + dst_offset, g_src + src_offset, len);
+    }
+    t_fast_copy = (now_ns() - start) / iterations;
+
+    printf("%-8s : %4u bytes, chksum lwIP %7.1f ns, fast %7.1f ns, %4.2fx, copy lwIP %7.1f ns, fast %7.1f ns, %4.2fx\n",
+           name, len, t_lwip, t_fast, t_lwip / t_fast, t_lwip_copy, t_fast_copy, t_lwip_copy / t_fast_copy);
+}
+
+int main(void)
+{
+    srand(1);
+
+    if (check())
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < MAX_LEN; i++)
+    {
+        g_src[i] = (uint8_t)rand();
+    }
+
+    bench("aligned", 1460, 0, 0);
+    bench("odd", 1461, 1, 1);
+    bench("mixed", 1460, 2, 0);
+    bench("small", 40, 0, 0);
+
+    return EXIT_SUCCESS;
+}
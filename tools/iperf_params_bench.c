@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) 2021 WIZnet Co.,Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * Host micro-benchmark of the iperf3 parameter parser against cJSON.
+ *
+ * Build and run from the repository root :
+ *
+ *   gcc -O2 -Iexamples/iperf3 -o iperf_params_bench tools/iperf_params_bench.c \
+ *       examples/iperf3/iperf_params.c examples/iperf3/cJSON.c
+ *   ./iperf_params_bench
+ *
+ * Both parsers read the same messages and must agree on the parameters the servers use.
+ * cJSON is given the heap, the time of its allocations is part of its cost.
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "iperf_params.h"
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+#define ITERATIONS 200000
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* Parameters of iperf3 3.16, -c -u -b 10M -l 1400 -P 2 -R */
+static const char g_udp_params[] =
+    "{\"udp\":true,\"omit\":0,\"time\":10,\"num\":0,\"blockcount\":0,\"parallel\":2,\"reverse\":true,"
+    "\"len\":1400,\"bandwidth\":10000000,\"pacing_timer\":1000,\"client_version\":\"3.16\"}";
+
+/* Parameters of iperf3 3.16, -c -t 30 -w 64K -M 1400 --get-server-output */
+static const char g_tcp_params[] =
+    "{\"tcp\":true,\"omit\":0,\"time\":30,\"num\":0,\"blockcount\":0,\"MSS\":1400,\"parallel\":1,"
+    "\"window\":65536,\"len\":131072,\"pacing_timer\":1000,\"get_server_output\":1,\"udp_counters_64bit\":1,"
+    "\"client_version\":\"3.16\"}";
+
+/* Largest message iperf3 accepts, the title and extra data fill it up */
+static char g_large_params[IPERF_PARAMS_MAX_SIZE + 1];
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void build_large_params(void)
+{
+    uint32_t len = 0;
+
+    len += snprintf(g_large_params, sizeof(g_large_params),
+                    "{\"tcp\":true,\"time\":10,\"parallel\":4,\"len\":131072,\"title\":\"");
+    while (len < 2048)
+    {
+        g_large_params[len++] = 't';
+    }
+    len += snprintf(g_large_params + len, sizeof(g_large_params) - len, "\",\"extra_data\":\"");
+    while (len < IPERF_PARAMS_MAX_SIZE - 64)
+    {
+        g_large_params[len] = (len % 16 == 0) ? ' ' : 'x';
+        len++;
+    }
+    snprintf(g_large_params + len, sizeof(g_large_params) - len, "\",\"reverse\":true,\"client_version\":\"3.16\"}");
+}
+
+/* What the servers read with cJSON before the parameter parser */
+static int cjson_params(const char *json, iperf_params_t *params)
+{
+    cJSON *root = cJSON_Parse(json);
+    cJSON *item = NULL;
+
+    memset(params, 0, sizeof(iperf_params_t));
+
+    if (root == NULL)
+    {
+        return 0;
+    }
+
+    item = cJSON_GetObjectItem(root, "reverse");
+    params->reverse = (item && cJSON_IsBool(item)) ? item->valueint : 0;
+    item = cJSON_GetObjectItem(root, "udp");
+    params->udp = (item && cJSON_IsBool(item)) ? item->valueint : 0;
+    item = cJSON_GetObjectItem(root, "parallel");
+    params->parallel = (item && cJSON_IsNumber(item)) ? item->valueint : 0;
+    item = cJSON_GetObjectItem(root, "len");
+    params->len = (item && cJSON_IsNumber(item)) ? item->valueint : 0;
+    item = cJSON_GetObjectItem(root, "bandwidth");
+    params->bandwidth = (item && cJSON_IsNumber(item)) ? (uint64_t)item->valuedouble : 0;
+    item = cJSON_GetObjectItem(root, "udp_counters_64bit");
+    params->udp_counters_64bit = (item && cJSON_IsNumber(item)) ? (item->valueint != 0) : 0;
+
+    cJSON_Delete(root);
+
+    return 1;
+}
+
+static int bench(const char *name, const char *json)
+{
+    uint32_t len = strlen(json);
+    uint32_t iterations = ITERATIONS * 256 / (len + 256);
+    iperf_params_t expected;
+    iperf_params_t params;
+    volatile uint32_t sink = 0;
+    double t_cjson = 0;
+    double t_params = 0;
+    double start = 0;
+
+    if (!cjson_params(json, &expected) || !iperf_params_parse(json, len, &params))
+    {
+        printf("%-6s : parse failed\n", name);
+        return 1;
+    }
+
+    if (params.reverse != expected.reverse || params.udp != expected.udp || params.parallel != expected.parallel ||
+        params.len != expected.len || params.bandwidth != expected.bandwidth ||
+        params.udp_counters_64bit != expected.udp_counters_64bit)
+    {
+        printf("%-6s : parsers disagree\n", name);
+        return 1;
+    }
+
+    start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        cjson_params(json, &expected);
+        sink += expected.parallel;
+    }
+    t_cjson = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        iperf_params_parse(json, len, &params);
+        sink += params.parallel;
+    }
+    t_params = (now_ns() - start) / iterations;
+
+    printf("%-6s : %5u bytes, cJSON %9.1f ns, iperf_params %9.1f ns, %5.1fx\n",
+           name, len, t_cjson, t_params, t_cjson / t_params);
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    build_large_params();
+
+    printf("Parser state %zu bytes, parameters %zu bytes, no allocation\n",
+           sizeof(iperf_params_parser_t), sizeof(iperf_params_t));
+
+    failed += bench("udp", g_udp_params);
+    failed += bench("tcp", g_tcp_params);
+    failed += bench("large", g_large_params);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,435 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 WIZnet Co.,Ltd
+#
+# SPDX-License-Identifier: BSD-3-Clause
+
+"""RAM, flash and stack report of a firmware, checked against a budget.
+
+RAM and flash are read from the GNU ld map file of the firmware and summed per
+component, per source module and per symbol. The stack is read from the
+-fstack-usage (.su) and -fcallgraph-info=su (.ci) files GCC writes next to the
+objects of the firmware: the frames of the functions and, when the call graph
+is there, the deepest call path from each root such as main.
+
+The report fails, with exit status 1, when the firmware exceeds its budget.
+The budget file is JSON, with one entry per firmware, all entries optional :
+
+    {
+        "w5x00_iperf_toe": {
+            "ram": 98304,
+            "flash": 262144,
+            "stack": {"main": 2048},
+            "modules": {"w5x00_iperf_toe.c": {"ram": 20480}}
+        }
+    }
+"""
+
+import argparse
+import glob
+import json
+import os
+import re
+import sys
+from collections import defaultdict
+
+# Address ranges of the RP2040 and RP2350, XIP flash and SRAM
+FLASH_RANGE = (0x10000000, 0x14000000)
+RAM_RANGE = (0x20000000, 0x20100000)
+
+# Output sections without their own input sections, only filled by the linker
+SKIPPED_SECTIONS = ("/DISCARD/",)
+
+SECTION_PREFIXES = (".text.", ".rodata.", ".data.", ".bss.", ".time_critical.",
+                    ".sram.text.", ".scratch_x.", ".scratch_y.", ".uninitialized_data.")
+
+OUTPUT_SECTION_RE = re.compile(r"^(\.\S+|\S+)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+load address 0x([0-9a-fA-F]+))?)?\s*$")
+INPUT_SECTION_RE = re.compile(r"^ (\.\S+|COMMON|\*fill\*)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+(\S.*))?)?\s*$")
+ADDRESS_SIZE_RE = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+(\S.*))?\s*$")
+ARCHIVE_RE = re.compile(r"^(.*?)([^/\\]+)\.a\((.+)\)$")
+
+SU_RE = re.compile(r"^(.*):(\d+):(\d+):(\S+)\s+(\d+)\s+(\S+)\s*$")
+CI_NODE_RE = re.compile(r'node:\s*\{\s*title:\s*"([^"]+)"\s*label:\s*"([^"]*)"')
+CI_EDGE_RE = re.compile(r'edge:\s*\{\s*sourcename:\s*"([^"]+)"\s*targetname:\s*"([^"]+)"')
+CI_FRAME_RE = re.compile(r"\\n(\d+) bytes \(([^)]*)\)")
+
+
+def in_range(addr, region):
+    return region[0] <= addr < region[1]
+
+
+def component_of(path):
+    """Library a linked object comes from."""
+    lowered = path.replace("\\", "/").lower()
+    # lwIP and mbedTLS come with the pico-sdk, they are checked first
+    for marker, name in (("lwip", "lwIP"), ("mbedtls", "mbedTLS"), ("pico-sdk", "pico-sdk"),
+                         ("iolibrary_driver", "ioLibrary"), ("iolibrary_files", "ioLibrary"),
+                         ("ethernet_files", "ioLibrary"), ("arm-none-eabi", "toolchain"), ("libgcc", "toolchain"),
+                         ("libc", "toolchain"), ("libm.a", "toolchain"), ("/port/", "port")):
+        if marker in lowered:
+            return name
+    return "application"
+
+
+def module_of(path):
+    """Source module of a linked object, the file name without the object suffix."""
+    archive = ARCHIVE_RE.match(path)
+    name = archive.group(3) if archive else os.path.basename(path)
+    for suffix in (".obj", ".o"):
+        if name.endswith(suffix):
+            name = name[:-len(suffix)]
+            break
+    return name
+
+
+def symbol_of(section, module):
+    for prefix in SECTION_PREFIXES:
+        if section.startswith(prefix):
+            return section[len(prefix):]
+    return "%s(%s)" % (module, section)
+
+
+class Usage:
+    def __init__(self):
+        self.ram = 0
+        self.flash = 0
+
+    def add(self, ram, flash):
+        self.ram += ram
+        self.flash += flash
+
+
+def parse_map(path):
+    """Sizes of the input sections of the map, with their objects."""
+    sections = []
+    output = None
+    output_load = None
+    pending = None  # Section name waiting for its address and size on the next line
+    started = False
+
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+
+            if not started:
+                started = line.startswith("Linker script and memory map")
+                continue
+            if line.startswith("OUTPUT(") or line.startswith("Cross Reference Table"):
+                break
+            if not line.strip():
+                continue
+
+            if pending is not None:
+                match = ADDRESS_SIZE_RE.match(line)
+                if match:
+                    if pending[0] == "output":
+                        output = pending[1]
+                        output_load = None
+                        load = re.search(r"load address 0x([0-9a-fA-F]+)", line)
+                        if load:
+                            output_load = int(load.group(1), 16)
+                    else:
+                        sections.append((output, output_load, pending[1], int(match.group(1), 16),
+                                         int(match.group(2), 16), (match.group(3) or "").strip()))
+                    pending = None
+                    continue
+                pending = None
+
+            if not line.startswith(" "):
+                match = OUTPUT_SECTION_RE.match(line)
+                if match and match.group(1).startswith("."):
+                    if match.group(2) is None:
+                        pending = ("output", match.group(1))
+                    else:
+                        output = match.group(1)
+                        output_load = int(match.group(4), 16) if match.group(4) else None
+                continue
+
+            match = INPUT_SECTION_RE.match(line)
+            if not match or output in SKIPPED_SECTIONS:
+                continue
+            if match.group(2) is None:
+                pending = ("input", match.group(1))
+                continue
+            sections.append((output, output_load, match.group(1), int(match.group(2), 16),
+                             int(match.group(3), 16), (match.group(4) or "").strip()))
+
+    return sections
+
+
+def memory_usage(sections):
+    total = Usage()
+    components = defaultdict(Usage)
+    modules = defaultdict(Usage)
+    symbols = defaultdict(Usage)
+
+    for output, load, name, addr, size, obj in sections:
+        if size == 0 or output is None:
+            continue
+
+        ram = size if in_range(addr, RAM_RANGE) else 0
+        # RAM sections with a load address are copied from flash at boot
+        flash = size if in_range(addr, FLASH_RANGE) or (ram and load is not None and in_range(load, FLASH_RANGE)) else 0
+        if not ram and not flash:
+            continue
+
+        if name == "*fill*" or not obj:
+            module = "(fill)"
+            component = "(fill)"
+            symbol = "(fill)"
+        else:
+            module = module_of(obj)
+            component = component_of(obj)
+            symbol = symbol_of(name, module)
+
+        total.add(ram, flash)
+        components[component].add(ram, flash)
+        modules[module].add(ram, flash)
+        symbols[(symbol, module)].add(ram, flash)
+
+    return total, components, modules, symbols
+
+
+def linked_objects(sections):
+    return sorted({obj for _, _, _, _, _, obj in sections if obj and (obj.endswith(".obj") or obj.endswith(".o") or obj.endswith(")"))})
+
+
+def stack_files(objects, map_dir, build_dir, suffix):
+    """.su or .ci file of each linked object, next to the object in the build directory."""
+    files = set()
+    index = None
+
+    for obj in objects:
+        archive = ARCHIVE_RE.match(obj)
+        if archive is None:
+            base = obj[:obj.rfind(".")] if obj.endswith((".obj", ".o")) else obj
+            path = os.path.normpath(os.path.join(map_dir, base + suffix))
+            if os.path.isfile(path):
+                files.add(path)
+            continue
+
+        # Objects of a static library are in CMakeFiles/<library>.dir, named after the source
+        library = archive.group(2)[3:] if archive.group(2).startswith("lib") else archive.group(2)
+        member = archive.group(3)
+        member = member[:member.rfind(".")] if member.endswith((".obj", ".o")) else member
+        if index is None:
+            index = defaultdict(list)
+            for path in glob.glob(os.path.join(build_dir, "**", "*" + suffix), recursive=True):
+                index[os.path.basename(path)].append(path)
+        for path in index.get(member + suffix, []):
+            if os.sep + "CMakeFiles" + os.sep + library + ".dir" + os.sep in path:
+                files.add(path)
+
+    return sorted(files)
+
+
+def parse_su(files):
+    frames = {}
+    for path in files:
+        with open(path, "r", errors="replace") as f:
+            for line in f:
+                match = SU_RE.match(line.strip())
+                if match:
+                    name = match.group(4)
+                    size = int(match.group(5))
+                    if size > frames.get(name, (0, ""))[0]:
+                        frames[name] = (size, match.group(6))
+    return frames
+
+
+class CallGraph:
+    def __init__(self):
+        self.frames = {}                 # Node of a defined function, its frame and qualifier
+        self.names = defaultdict(list)   # Function name, its nodes
+        self.edges = defaultdict(set)
+        self.called = set()
+
+    def load(self, files):
+        raw_edges = []
+        for path in files:
+            unit = os.path.basename(path)
+            local = {}
+            with open(path, "r", errors="replace") as f:
+                text = f.read()
+            for title, label in CI_NODE_RE.findall(text):
+                frame = CI_FRAME_RE.search(label)
+                if frame is None:
+                    continue
+                node = unit + ":" + title
+                self.frames[node] = (int(frame.group(1)), frame.group(2))
+                self.names[title].append(node)
+                local[title] = node
+            for source, target in CI_EDGE_RE.findall(text):
+                raw_edges.append((local, source, target))
+
+        for local, source, target in raw_edges:
+            if source not in local:
+                continue
+            # Calls resolve to the function of the same unit first, static functions share names across units
+            if target in local:
+                nodes = [local[target]]
+            elif target in self.names:
+                nodes = self.names[target]
+            else:
+                nodes = ["?:" + target]
+            for node in nodes:
+                self.edges[local[source]].add(node)
+                self.called.add(node)
+
+    def roots(self):
+        return [node for node in self.frames if node not in self.called]
+
+    def worst_path(self, node, memo=None, stack=None):
+        """Deepest path from node, its depth and whether it is exact."""
+        memo = {} if memo is None else memo
+        stack = set() if stack is None else stack
+        if node in memo:
+            return memo[node]
+
+        frame, qualifier = self.frames.get(node, (0, "unknown"))
+        exact = node in self.frames and ("dynamic" not in qualifier or qualifier == "dynamic,bounded")
+        best = (0, [], True)
+
+        stack.add(node)
+        for callee in sorted(self.edges.get(node, ())):
+            if callee in stack:
+                exact = False  # Recursion, counted once
+                continue
+            depth, path, callee_exact = self.worst_path(callee, memo, stack)
+            if depth > best[0] or (depth == best[0] and not best[1]):
+                best = (depth, path, callee_exact)
+            exact = exact and callee_exact
+        stack.discard(node)
+
+        result = (frame + best[0], [node] + best[1], exact and best[2])
+        memo[node] = result
+        return result
+
+    def describe(self, path):
+        parts = []
+        for node in path:
+            name = node.split(":", 1)[1]
+            if node in self.frames:
+                parts.append("%s (%d)" % (name, self.frames[node][0]))
+            else:
+                parts.append("%s (?)" % name)
+        return " > ".join(parts)
+
+
+def print_table(title, rows, limit):
+    print("[memory] %s :" % title)
+    print("  %9s %9s" % ("RAM", "Flash"))
+    for name, usage in rows[:limit]:
+        print("  %9d %9d  %s" % (usage.ram, usage.flash, name))
+    if len(rows) > limit:
+        print("  ... %d more" % (len(rows) - limit))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--target", required=True, help="firmware name, the entry of the budget file")
+    parser.add_argument("--map", required=True, help="linker map file of the firmware")
+    parser.add_argument("--build-dir", required=True, help="build directory holding the .su and .ci files")
+    parser.add_argument("--budget", help="JSON budget file")
+    parser.add_argument("--top", type=int, default=15, help="rows per table")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.map):
+        print("[memory] %s : map file %s not found" % (args.target, args.map))
+        return 1
+
+    budget = {}
+    if args.budget:
+        with open(args.budget, "r") as f:
+            budget = json.load(f).get(args.target, {})
+
+    sections = parse_map(args.map)
+    total, components, modules, symbols = memory_usage(sections)
+    failures = []
+
+    def check(what, used, limit):
+        if limit is not None and used > limit:
+            failures.append("%s %d bytes exceeds budget of %d bytes" % (what, used, limit))
+        return "" if limit is None else " / %d (%d%%)" % (limit, used * 100 // limit if limit else 0)
+
+    print("[memory] %s" % args.target)
+    print("[memory] RAM   %8d bytes%s" % (total.ram, check("RAM", total.ram, budget.get("ram"))))
+    print("[memory] Flash %8d bytes%s" % (total.flash, check("Flash", total.flash, budget.get("flash"))))
+
+    by_ram = lambda item: (-item[1].ram, -item[1].flash, item[0])
+    by_flash = lambda item: (-item[1].flash, -item[1].ram, item[0])
+
+    print_table("By component", sorted(components.items(), key=by_ram), args.top)
+    print_table("RAM by module", [item for item in sorted(modules.items(), key=by_ram) if item[1].ram], args.top)
+    print_table("Flash by module", [item for item in sorted(modules.items(), key=by_flash) if item[1].flash], args.top)
+    print_table("RAM by symbol",
+                [("%s  [%s]" % key, usage) for key, usage in sorted(symbols.items(), key=by_ram) if usage.ram], args.top)
+    print_table("Flash by symbol",
+                [("%s  [%s]" % key, usage) for key, usage in sorted(symbols.items(), key=by_flash) if usage.flash], args.top)
+
+    for module, limits in sorted(budget.get("modules", {}).items()):
+        usage = modules.get(module, Usage())
+        check("%s RAM" % module, usage.ram, limits.get("ram"))
+        check("%s flash" % module, usage.flash, limits.get("flash"))
+
+    # Stack
+    objects = linked_objects(sections)
+    map_dir = os.path.dirname(os.path.abspath(args.map))
+    su_files = stack_files(objects, map_dir, args.build_dir, ".su")
+    ci_files = stack_files(objects, map_dir, args.build_dir, ".ci")
+    frames = parse_su(su_files)
+
+    if not frames:
+        print("[memory] Stack : no .su files, configure with -DIPERF_MEMORY_REPORT=ON")
+    else:
+        print("[memory] Largest frames, %d functions :" % len(frames))
+        for name, (size, qualifier) in sorted(frames.items(), key=lambda item: (-item[1][0], item[0]))[:args.top]:
+            print("  %9d  %s%s" % (size, name, "" if qualifier == "static" else " (%s)" % qualifier))
+
+    graph = CallGraph()
+    graph.load(ci_files)
+    stack_budget = budget.get("stack", {})
+
+    if not graph.frames:
+        if frames:
+            print("[memory] Stack paths : no .ci files, the compiler has no -fcallgraph-info")
+        for root, limit in sorted(stack_budget.items()):
+            # Without the call graph, the frame of the root alone is a lower bound
+            check("Stack of %s" % root, frames.get(root, (0, ""))[0], limit)
+    else:
+        roots = set(graph.roots())
+        for root in stack_budget:
+            roots.update(graph.names.get(root, []))
+
+        results = []
+        memo = {}
+        for node in roots:
+            depth, path, exact = graph.worst_path(node, memo)
+            results.append((depth, node, path, exact))
+        results.sort(key=lambda item: (-item[0], item[1]))
+
+        print("[memory] Worst stack per call path, '?' is outside the analyzed objects :")
+        shown = set()
+        for root in sorted(stack_budget):
+            nodes = graph.names.get(root, [])
+            if not nodes:
+                print("  %s : not found" % root)
+                continue
+            depth, node, path, exact = max((r for r in results if r[1] in nodes), key=lambda r: r[0])
+            shown.add(node)
+            print("  %9d%s%s  %s" % (depth, "" if exact else "+", check("Stack of %s" % root, depth, stack_budget[root]),
+                                     graph.describe(path)))
+        for depth, node, path, exact in [r for r in results if r[1] not in shown][:args.top]:
+            print("  %9d%s  %s" % (depth, "" if exact else "+", graph.describe(path)))
+        print("[memory] '+' marks a path with recursion, dynamic frames or calls outside the analyzed objects")
+
+    if failures:
+        for failure in failures:
+            print("[memory] %s : %s" % (args.target, failure))
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())